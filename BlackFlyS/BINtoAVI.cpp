@@ -7,6 +7,10 @@ After recording hardware triggered, synchronized images to binary files in the p
 this file converts the binary file back to a vector of images and creates a video file.
 Note that FrameRate and imageHeight and imageWidth are hardcoded from previous recording settings
 and need to be adapted before compiling the executable file. Install Spinnaker SDK before using this script.
+Videos are written through a VideoEncoder backend: SpinVideo (MJPG/H264/UNCOMPRESSED) or an external
+encoder process such as ffmpeg that reads raw frames from a pipe (PIPE). With Mosaic=1 all binary files
+of a session are tiled into a single video, aligned by the FrameID and Timestamp columns of the logfile.
+ProxyScale exports low resolution previews, downscaled in the Bayer domain before demosaicing.
 
 MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
 Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
@@ -25,6 +29,30 @@ Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
 #include <time.h>
 #include "SpinVideo.h"
 #include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
+#include <cmath>
+#include <functional>
+#include "Downscale.h"
+#include "SyncTable.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <sys/resource.h>
+#include <csignal>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
 
 using namespace Spinnaker;
 using namespace Spinnaker::GenApi;
@@ -38,8 +66,21 @@ double frameRateToSet = 100;
 int imageHeight = 1080;
 int imageWidth = 1440;
 int color = 1; // 1= color, else = mono
-std::string chosenVideoType = "MJPG"; 
+std::string chosenVideoType = "MJPG"; // MJPG, H264, UNCOMPRESSED or PIPE
 std::string path;
+int batchSize = 500; // frames per read batch, two batches are kept in RAM
+std::string retimeLog; // csv logfile of the recording, enables constant frame rate re-timing
+std::string syncTable; // sync table saved by LOGtoSYNC, used instead of aligning RetimeLog
+std::string gapFill = "DUPLICATE"; // DUPLICATE or BLANK for missing frames when re-timing
+int mosaic = 0; // 1 = tile all binary files into one video
+int mosaicColumns = 3; // number of tiles per mosaic row
+int mosaicScale = 2; // integer downscale factor of each tile
+int proxyScale = 1; // integer downscale factor of proxy videos, 1 = full resolution
+
+// Command line of the external encoder used with chosenVideoType=PIPE. Raw frames are written to its stdin,
+// {width} {height} {fps} {pix_fmt} and {output} are replaced before the process is started, {output} is quoted
+// for the shell, so paths with spaces work and it must not be quoted again.
+std::string encoderCommand = "ffmpeg -y -loglevel error -f rawvideo -pix_fmt {pix_fmt} -s {width}x{height} -r {fps} -i - -c:v libx264 -preset veryfast -crf 18 -pix_fmt yuv420p {output}.mp4";
 
 /*
 ================
@@ -57,7 +98,10 @@ auto readconfig(string metadata)
 		std::string line;
 		while (getline(cFile, line))
 		{
-			line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
+			// keep the raw line for values that contain spaces
+			std::string rawLine = line;
+
+			line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
 			if (line[0] == '#' || line.empty()) continue;
 
 			auto delimiterPos = line.find("=");
@@ -71,6 +115,21 @@ auto readconfig(string metadata)
 			else if (name == "ColorVideo") color = std::stod(value);
 			else if (name == "chosenVideoType") chosenVideoType = value;
 			else if (name == "VideoPath") path = value;
+			else if (name == "BatchSize") batchSize = std::stoi(value);
+			else if (name == "RetimeLog") retimeLog = value;
+			else if (name == "SyncTable") syncTable = value;
+			else if (name == "GapFill") gapFill = value;
+			else if (name == "Mosaic") mosaic = std::stoi(value);
+			else if (name == "MosaicColumns") mosaicColumns = std::stoi(value);
+			else if (name == "MosaicScale") mosaicScale = std::stoi(value);
+			else if (name == "ProxyScale") proxyScale = std::stoi(value);
+			else if (name == "EncoderCommand")
+			{
+				std::string command = rawLine.substr(rawLine.find("=") + 1);
+				command.erase(0, command.find_first_not_of(" \t"));
+				command.erase(command.find_last_not_of(" \t\r") + 1);
+				encoderCommand = command;
+			}
 		}
 	}
 	else
@@ -83,22 +142,363 @@ auto readconfig(string metadata)
 	std::cout << "\nImageWidth=" << imageWidth;
 	std::cout << "\nColorVideo=" << color;
 	std::cout << "\nchosenVideoType=" << chosenVideoType;
+	std::cout << "\nBatchSize=" << batchSize;
+	if (!retimeLog.empty() || !syncTable.empty())
+	{
+		std::cout << "\nRetimeLog=" << retimeLog;
+		std::cout << "\nSyncTable=" << syncTable;
+		std::cout << "\nGapFill=" << gapFill;
+	}
+	if (mosaic == 1)
+	{
+		std::cout << "\nMosaicColumns=" << mosaicColumns;
+		std::cout << "\nMosaicScale=" << mosaicScale;
+	}
+	if (chosenVideoType == "PIPE")
+	{
+		std::cout << "\nEncoderCommand=" << encoderCommand;
+	}
+	if (proxyScale > 1)
+	{
+		std::cout << "\nProxyScale=" << proxyScale;
+	}
 	std::cout << "\nVideoPath=" << path << endl << endl;
 
 	return result, frameRateToSet, imageHeight, imageWidth, color, chosenVideoType, path;
 }
 
 
+/*
+=================
+The class VideoEncoder is the interface for all video backends. Frames are passed as raw buffers of width x height pixels in the given pixel format, so the reading side does not depend on the chosen backend.
+=================
+*/
+class VideoEncoder
+{
+public:
+	virtual ~VideoEncoder() {}
+	virtual int Open(const string& videoFilename, unsigned int width, unsigned int height, PixelFormatEnums format) = 0;
+	virtual int Append(const char* frameData) = 0;
+	virtual int Close() = 0;
+};
 
 /*
 =================
-The function SaveVectorToVideo takes an image vector and converts it into avi. Parameters like frameRateToSet, k_videoFileSize, MJPGquality and H264bitrate are changed within the function.
+The class SpinVideoEncoder writes AVI files with the Spinnaker SpinVideo recorder. MJPG quality, H264 bitrate and the 4GB file split are set here.
 =================
 */
-int SaveVectorToVideo(string tempFilename, vector<ImagePtr>& images, int part)
+class SpinVideoEncoder : public VideoEncoder
 {
-	int result = 0;
+public:
+	SpinVideoEncoder(string videoType) : videoType(videoType), width(0), height(0), format(PixelFormat_Mono8) {}
+
+	int Open(const string& videoFilename, unsigned int frameWidth, unsigned int frameHeight, PixelFormatEnums pixelFormat)
+	{
+		width = frameWidth;
+		height = frameHeight;
+		format = pixelFormat;
+
+		try
+		{
+			// Set maximum video file size to 4GB. A new video file is generated when limit is reached. Setting maximum file size to 0 indicates no limit.
+			const unsigned int k_videoFileSize = 4096;
+
+			video.SetMaximumFileSize(k_videoFileSize);
+
+			// Setting chosenVideoType. Once the desired option object is configured, open the video file with the option in order to create the video file.
+			if (videoType == "MJPG")
+			{
+				Video::MJPGOption option;
+
+				option.frameRate = frameRateToSet;
+				option.quality = 95;
+
+				video.Open(videoFilename.c_str(), option);
+				cout << "VideoType set to MJPG" << endl;
+			}
+			else if (videoType == "H264")
+			{
+				Video::H264Option option;
+
+				option.frameRate = frameRateToSet;
+				option.bitrate = 1000000;
+				option.height = height;
+				option.width = width;
+
+				video.Open(videoFilename.c_str(), option);
+				cout << "VideoType set to H264" << endl;
+			}
+			else // UNCOMPRESSED
+			{
+				Video::AVIOption option;
+
+				option.frameRate = frameRateToSet;
+
+				video.Open(videoFilename.c_str(), option);
+				cout << "VideoType set to UNCOMPRESSED" << endl;
+			}
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "Error: " << e.what() << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	int Append(const char* frameData)
+	{
+		try
+		{
+			// Wrap the raw buffer without copying, SpinVideo encodes it before returning
+			ImagePtr pImage = Image::Create(width, height, 0, 0, format, const_cast<char*>(frameData));
+			video.Append(pImage);
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "Error: " << e.what() << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	int Close()
+	{
+		try
+		{
+			video.Close();
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "Error: " << e.what() << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+private:
+	SpinVideo video;
+	string videoType;
+	unsigned int width;
+	unsigned int height;
+	PixelFormatEnums format;
+};
+
+/*
+=================
+The class PipeEncoder starts the external encoder from encoderCommand and streams raw frames to its stdin. Any locally installed encoder that reads rawvideo from a pipe can be used, e.g. ffmpeg with multithreaded libx264 or ffv1. The command runs through the shell, so QuoteArgument quotes the output path, which comes from the metadata and may contain spaces.
+=================
+*/
+class PipeEncoder : public VideoEncoder
+{
+public:
+	PipeEncoder(string command) : commandTemplate(command), pipe(nullptr), frameSize(0) {}
+
+	~PipeEncoder()
+	{
+		Close();
+	}
+
+	int Open(const string& videoFilename, unsigned int width, unsigned int height, PixelFormatEnums format)
+	{
+		string pixelFormat;
+		if (format == PixelFormat_BayerRG8)
+		{
+			pixelFormat = "bayer_rggb8";
+			frameSize = width * height;
+		}
+		else if (format == PixelFormat_BGR8)
+		{
+			pixelFormat = "bgr24";
+			frameSize = width * height * 3;
+		}
+		else
+		{
+			pixelFormat = "gray";
+			frameSize = width * height;
+		}
+
+		string command = commandTemplate;
+		ReplaceAll(command, "{width}", to_string(width));
+		ReplaceAll(command, "{height}", to_string(height));
+		ReplaceAll(command, "{fps}", to_string(frameRateToSet));
+		ReplaceAll(command, "{pix_fmt}", pixelFormat);
+		ReplaceAll(command, "{output}", QuoteArgument(videoFilename));
+
+		cout << "VideoType set to PIPE" << endl;
+		cout << "Starting encoder: " << command << endl;
+
+#if defined(_WIN32)
+		pipe = popen(command.c_str(), "wb");
+#else
+		// glibc rejects the binary mode flag, and an encoder that exits early must not kill BINtoAVI with SIGPIPE
+		signal(SIGPIPE, SIG_IGN);
+		pipe = popen(command.c_str(), "w");
+#endif
+		if (pipe == nullptr)
+		{
+			cout << "Unable to start encoder process. Aborting..." << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	int Append(const char* frameData)
+	{
+		if (fwrite(frameData, 1, frameSize, pipe) != frameSize)
+		{
+			cout << "Error writing to encoder process!" << endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	int Close()
+	{
+		int result = 0;
+		if (pipe != nullptr)
+		{
+			// pclose waits for the encoder to flush and finish the video file
+			if (pclose(pipe) != 0)
+			{
+				cout << "Encoder process exited with errors." << endl;
+				result = -1;
+			}
+			pipe = nullptr;
+		}
+		return result;
+	}
 
+private:
+	static void ReplaceAll(string& text, const string& from, const string& to)
+	{
+		size_t pos = 0;
+		while ((pos = text.find(from, pos)) != string::npos)
+		{
+			text.replace(pos, from.length(), to);
+			pos += to.length();
+		}
+	}
+
+	// A suffix like {output}.mp4 stays outside the quotes, the shell and the Windows runtime join both parts
+	static string QuoteArgument(const string& argument)
+	{
+#if defined(_WIN32)
+		return "\"" + argument + "\""; // Windows paths can not contain quotes
+#else
+		string quoted = "'";
+		for (char c : argument)
+		{
+			quoted += (c == '\'') ? string("'\\''") : string(1, c);
+		}
+		return quoted + "'";
+#endif
+	}
+
+	string commandTemplate;
+	FILE* pipe;
+	size_t frameSize;
+};
+
+/*
+=================
+The function CreateEncoder returns the VideoEncoder backend for chosenVideoType.
+=================
+*/
+unique_ptr<VideoEncoder> CreateEncoder()
+{
+	if (chosenVideoType == "PIPE")
+	{
+		return unique_ptr<VideoEncoder>(new PipeEncoder(encoderCommand));
+	}
+	return unique_ptr<VideoEncoder>(new SpinVideoEncoder(chosenVideoType));
+}
+
+
+/*
+=================
+The class FrameDoubleBuffer hands two batches of raw frames back and forth between the reading thread and the encoding thread, so that the next batch is read from disk while the current batch is encoded.
+=================
+*/
+struct FrameBatch
+{
+	vector<char> data;
+	size_t count = 0;
+};
+
+class FrameDoubleBuffer
+{
+public:
+	FrameDoubleBuffer(size_t frameSize, size_t framesPerBatch) : full{ false, false }, finished(false), writeIndex(0), readIndex(0)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			batches[i].data.resize(frameSize * framesPerBatch);
+		}
+	}
+
+	// Reader side: wait until the next batch has been encoded and can be refilled
+	FrameBatch* AcquireEmpty()
+	{
+		unique_lock<mutex> lock(batchMutex);
+		batchCondition.wait(lock, [this] { return !full[writeIndex]; });
+		batches[writeIndex].count = 0;
+		return &batches[writeIndex];
+	}
+
+	void PublishFull()
+	{
+		lock_guard<mutex> lock(batchMutex);
+		full[writeIndex] = true;
+		writeIndex = 1 - writeIndex;
+		batchCondition.notify_all();
+	}
+
+	void Finish()
+	{
+		lock_guard<mutex> lock(batchMutex);
+		finished = true;
+		batchCondition.notify_all();
+	}
+
+	// Encoder side: returns nullptr once the reader has finished and all batches are encoded
+	FrameBatch* AcquireFull()
+	{
+		unique_lock<mutex> lock(batchMutex);
+		batchCondition.wait(lock, [this] { return full[readIndex] || finished; });
+		if (!full[readIndex])
+		{
+			return nullptr;
+		}
+		return &batches[readIndex];
+	}
+
+	void ReleaseEmpty()
+	{
+		lock_guard<mutex> lock(batchMutex);
+		full[readIndex] = false;
+		readIndex = 1 - readIndex;
+		batchCondition.notify_all();
+	}
+
+private:
+	FrameBatch batches[2];
+	bool full[2];
+	bool finished;
+	int writeIndex;
+	int readIndex;
+	mutex batchMutex;
+	condition_variable batchCondition;
+};
+
+
+/*
+=================
+The function TestWritePermission checks that video files can be created in the output path.
+=================
+*/
+int TestWritePermission()
+{
 	// Test write permission
 	string testpath = path + "/test.txt";
 	const char* testfile = testpath.c_str() ;
@@ -113,189 +513,812 @@ int SaveVectorToVideo(string tempFilename, vector<ImagePtr>& images, int part)
 
 	fclose(tempFile);
 	remove(testfile);
+	return 0;
+}
 
+/*
+=================
+The function SerialFromFilename extracts the camera serial number from a binary filename created by RECtoBIN, i.e. <date>_<time>_<serial>_file<cnt>.tmp
+=================
+*/
+string SerialFromFilename(const string& tempFilename)
+{
+	size_t filePos = tempFilename.rfind("_file");
+	if (filePos == string::npos)
+	{
+		return "";
+	}
+	size_t serialPos = tempFilename.rfind('_', filePos - 1);
+	if (serialPos == string::npos)
+	{
+		return "";
+	}
+	return tempFilename.substr(serialPos + 1, filePos - serialPos - 1);
+}
 
-	cout << endl << "*** CONVERTING VIDEO ***" << endl << endl;
-	try
+/*
+=================
+The function TrialFromFilename returns the trial number of a binary file recorded in session mode, <...>_trial<k>.tmp, or an empty string for regular recordings.
+=================
+*/
+string TrialFromFilename(const string& tempFilename)
+{
+	size_t trialPos = tempFilename.rfind("_trial");
+	if (trialPos == string::npos)
 	{
-		// FILENAME 
-		string videoFilename = path + tempFilename.substr(3, tempFilename.length() - 7) + "_" + to_string(part);
+		return "";
+	}
+	size_t trialEnd = tempFilename.find_first_not_of("0123456789", trialPos + 6);
+	return tempFilename.substr(trialPos + 6, trialEnd - trialPos - 6);
+}
 
-		cout << "Frame Rate set to " << frameRateToSet << " FPS" << endl;
+/*
+=================
+The class SegmentedFile reads a binary file like ifstream. Given a .idx index written by RECtoBIN for segmented recordings, it reads all listed segments one after another as one file, wherever they were striped to. Frames never span two segments.
+=================
+*/
+class SegmentedFile
+{
+public:
+	void open(const string& filename, ios_base::openmode mode = ios_base::in | ios_base::binary)
+	{
+		segments.clear();
+		nextSegment = 0;
+		failed = false;
+		this->mode = mode;
 
-		// Start and open video file
-		SpinVideo video;
+		if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".idx") == 0)
+		{
+			ifstream indexFile(filename);
+			string segment;
+			while (getline(indexFile, segment))
+			{
+				segment.erase(segment.find_last_not_of("\r") + 1);
+				if (!segment.empty())
+				{
+					segments.push_back(segment);
+				}
+			}
+		}
+		else
+		{
+			segments.push_back(filename);
+		}
+		failed = !OpenNextSegment();
+	}
 
-		// Set maximum video file size to 4GB. A new video file is generated when limit is reached. Setting maximum file size to 0 indicates no limit.
-		const unsigned int k_videoFileSize = 4096;
+	SegmentedFile& read(char* data, streamsize size)
+	{
+		while (!failed && !file.read(data, size))
+		{
+			// Continue with the next segment at the end of a complete frame only
+			if (file.gcount() != 0 || !OpenNextSegment())
+			{
+				failed = true;
+			}
+		}
+		return *this;
+	}
 
-		video.SetMaximumFileSize(k_videoFileSize);
+	explicit operator bool() const
+	{
+		return !failed;
+	}
+
+	bool operator!() const
+	{
+		return failed;
+	}
 
-		// Setting chosenVideoType. Once the desired option object is configured, open the video file with the option in order to create the video file.	
-		if (chosenVideoType =="MJPG")
+	void close()
+	{
+		file.close();
+	}
+
+private:
+	bool OpenNextSegment()
+	{
+		file.close();
+		file.clear();
+		if (nextSegment >= segments.size())
 		{
-			Video::MJPGOption option;
+			return false;
+		}
+		const string& segment = segments[nextSegment++];
+		file.open(segment.c_str(), mode);
+		if (!file)
+		{
+			cout << "Error opening segment: " << segment << endl;
+			return false;
+		}
+		return true;
+	}
 
-			option.frameRate = frameRateToSet;
-			option.quality = 95;
+	ifstream file;
+	vector<string> segments;
+	size_t nextSegment = 0;
+	bool failed = false;
+	ios_base::openmode mode = ios_base::in | ios_base::binary;
+};
 
-			video.Open(videoFilename.c_str(), option);
-			cout << "VideoType set to MJPG" << endl;
+/*
+=================
+The function AlignFiles places every frame of the binary files on its session frame, i.e. the trigger pulse it was exposed on, using the sync table of SyncTable.h. The table is aligned from RetimeLog, or read from a SyncTable file saved by LOGtoSYNC. frameSlots holds the session frame of each frame in file order, frames without a session frame of their own get -1 and are dropped. All files must belong to the same trial, files without a trial in their name belong to trial 1. A SyncTable file must have been saved for this trial and Framerate.
+=================
+*/
+int AlignFiles(vector<string>& filenames, vector<vector<int64_t>>& frameSlots, vector<vector<uint64_t>>& frameIDs, int64_t& sessionFrames)
+{
+	int numFiles = (int)filenames.size();
+	vector<string> serials(numFiles);
+	string trial = TrialFromFilename(filenames.at(0));
+	for (int fileCnt = 0; fileCnt < numFiles; fileCnt++)
+	{
+		serials[fileCnt] = SerialFromFilename(filenames.at(fileCnt));
+		if (TrialFromFilename(filenames.at(fileCnt)) != trial)
+		{
+			cout << "Files of different trials can not be aligned together. Aborting..." << endl;
+			return -1;
 		}
-		else if (chosenVideoType == "H264")
+	}
+
+	// The files created at the start of a recording hold trial 1
+	if (trial.empty())
+	{
+		trial = "1";
+	}
+
+	// Stores one table row, column c of the table belongs to file columns[c] or to none
+	vector<int> columns;
+	auto storeRow = [&](int64_t sessionFrame, const int32_t* offsets, const uint64_t* ids)
+	{
+		for (size_t c = 0; c < columns.size(); c++)
 		{
-			Video::H264Option option;
+			if (columns[c] < 0 || offsets[c] == SYNC_MISSING)
+			{
+				continue;
+			}
+			vector<int64_t>& slots = frameSlots[columns[c]];
+			if (slots.size() <= (size_t)offsets[c])
+			{
+				slots.resize(offsets[c] + 1, -1);
+				frameIDs[columns[c]].resize(offsets[c] + 1, 0);
+			}
+			slots[offsets[c]] = sessionFrame;
+			frameIDs[columns[c]][offsets[c]] = ids[c];
+		}
+		sessionFrames = sessionFrame + 1;
+	};
 
-			option.frameRate = frameRateToSet;
-			option.bitrate = 1000000;
-			option.height = static_cast<unsigned int>(images[0]->GetHeight());
-			option.width = static_cast<unsigned int>(images[0]->GetWidth());
+	if (!syncTable.empty())
+	{
+		vector<string> tableSerials;
+		double tableFrameRate = 0;
+		uint32_t tableTrial = 0;
+		auto storeTableRow = [&](int64_t sessionFrame, const int32_t* offsets, const uint64_t* ids)
+		{
+			if (columns.empty())
+			{
+				for (string& serial : tableSerials)
+				{
+					auto file = find(serials.begin(), serials.end(), serial);
+					columns.push_back(file != serials.end() ? (int)(file - serials.begin()) : -1);
+				}
+			}
+			storeRow(sessionFrame, offsets, ids);
+		};
+		if (ReadSyncTable(syncTable, tableSerials, tableFrameRate, tableTrial, storeTableRow) != 0)
+		{
+			cout << "Error reading sync table: " << syncTable << ", run LOGtoSYNC of this version again. Aborting..." << endl;
+			return -1;
+		}
 
-			video.Open(videoFilename.c_str(), option);
-			cout << "VideoType set to H264" << endl;
+		// A table of another trial or frame rate would place the frames on the wrong session frames
+		if (tableTrial != 0 && tableTrial != SyncTrialNumber(trial))
+		{
+			cout << "Sync table " << syncTable << " belongs to trial " << tableTrial << ", the files to trial " << trial << ". Aborting..." << endl;
+			return -1;
 		}
-		else // UNCOMPRESSED
+		if (fabs(tableFrameRate - frameRateToSet) > 1e-3 * frameRateToSet)
 		{
-			Video::AVIOption option;
+			cout << "Sync table " << syncTable << " was aligned at " << tableFrameRate << " FPS, the recording has " << frameRateToSet << " FPS. Aborting..." << endl;
+			return -1;
+		}
+		cout << "Sync table " << syncTable << ": " << sessionFrames << " session frames of " << tableSerials.size() << " cameras" << endl;
+	}
+	else
+	{
+		for (int fileCnt = 0; fileCnt < numFiles; fileCnt++)
+		{
+			columns.push_back(fileCnt);
+		}
+		SyncTable table;
+		table.Init(serials, frameRateToSet);
+		table.emit = storeRow;
+		if (ReadSyncLog(retimeLog, trial, table) < 0)
+		{
+			cout << "Error opening logfile: " << retimeLog << " Aborting..." << endl;
+			return -1;
+		}
+		ReportSyncTable(table, cout);
+	}
+
+	for (int fileCnt = 0; fileCnt < numFiles; fileCnt++)
+	{
+		if (frameSlots[fileCnt].empty())
+		{
+			cout << "No frames of camera [" << serials[fileCnt] << "] found in " << (syncTable.empty() ? retimeLog : syncTable) << " Aborting..." << endl;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+=================
+The function ConvertFileToVideo reads one binary file in batches of batchSize frames and appends them to a video through the chosen VideoEncoder. Reading and encoding run on two threads sharing a FrameDoubleBuffer.
+With ProxyScale above 1 the frames are downscaled by ProxyDownscale before encoding, Bayer frames become BGR8 without full resolution demosaicing.
+If frameSlots is given, every frame is placed on its session frame (see AlignFiles). Missing slots are filled with a copy of the previous frame (GapFill=DUPLICATE) or a black frame (GapFill=BLANK), and the video is padded to sessionFrames. Every inserted or dropped slot is reported in <video>_retime.csv.
+=================
+*/
+int ConvertFileToVideo(string tempFilename, const vector<int64_t>* frameSlots, const vector<uint64_t>* frameIDs, int64_t sessionFrames)
+{
+	int result = 0;
+	size_t imageSize = (size_t)imageHeight * imageWidth;
+	PixelFormatEnums format = (color == 1) ? PixelFormat_BayerRG8 : PixelFormat_Mono8;
+
+	// Proxy videos are encoded at reduced size, Bayer frames are demosaiced on the way
+	bool proxy = proxyScale > 1;
+	int outputWidth = imageWidth / proxyScale;
+	int outputHeight = imageHeight / proxyScale;
+	int outputChannels = (proxy && color == 1) ? 3 : 1;
+	size_t outputStride = (size_t)outputWidth * outputChannels;
+	size_t outputSize = outputStride * outputHeight;
+	if (proxy && color == 1)
+	{
+		format = PixelFormat_BGR8;
+	}
+
+	cout << endl << "*** READING BINARY FILE ***" << endl << endl;
+	cout << "Opening " << tempFilename.c_str() << "..." << endl;
+
+	SegmentedFile rawFile;
+	rawFile.open(tempFilename, ios_base::in | ios_base::binary);
+	if (!rawFile)
+	{
+		cout << "Error opening file: " << tempFilename.c_str() << " Aborting..." << endl;
+		return -1;
+	}
+
+	cout << endl << "*** CONVERTING VIDEO ***" << endl << endl;
+
+	// FILENAME
+	string videoFilename = path + tempFilename.substr(3, tempFilename.length() - 7);
+	if (proxy)
+	{
+		videoFilename += "_proxy" + to_string(proxyScale);
+		cout << "Proxy size set to " << outputWidth << " x " << outputHeight << endl;
+	}
+
+	cout << "Frame Rate set to " << frameRateToSet << " FPS" << endl;
 
-			option.frameRate = frameRateToSet;
+	unique_ptr<VideoEncoder> encoder = CreateEncoder();
+	if (encoder->Open(videoFilename, outputWidth, outputHeight, format) != 0)
+	{
+		return -1;
+	}
+
+	// Encoding thread consumes batches while this thread reads the next one
+	FrameDoubleBuffer buffer(outputSize, batchSize);
+	size_t framesEncoded = 0;
+	atomic<int> encoderResult(0);
 
-			video.Open(videoFilename.c_str(), option);
-			cout << "VideoType set to UNCOMPRESSED" << endl;
+	thread encoderThread([&]()
+	{
+		FrameBatch* batch;
+		while ((batch = buffer.AcquireFull()) != nullptr)
+		{
+			for (size_t frameCnt = 0; frameCnt < batch->count && encoderResult == 0; frameCnt++)
+			{
+				encoderResult = encoder->Append(&batch->data[frameCnt * outputSize]);
+			}
+			framesEncoded += batch->count;
+			buffer.ReleaseEmpty();
 		}
+	});
 
+	// Returns the next free frame in the current batch, handing full batches to the encoding thread
+	FrameBatch* batch = buffer.AcquireEmpty();
+	auto nextFrameBuffer = [&]() -> char*
+	{
+		if (batch->count == (size_t)batchSize)
+		{
+			buffer.PublishFull();
+			batch = buffer.AcquireEmpty();
+		}
+		return &batch->data[batch->count * outputSize];
+	};
 
-		// Construct and save video
-		cout << "Appending " << images.size() << " images to video file... ";
+	// Appends one raw frame to the current batch, downscaled for proxy videos
+	vector<uint8_t> scratch;
+	auto appendFrame = [&](const char* rawFrame)
+	{
+		char* dst = nextFrameBuffer();
+		if (proxy)
+		{
+			ProxyDownscale(reinterpret_cast<const uint8_t*>(rawFrame), imageWidth, imageHeight, color == 1, proxyScale, reinterpret_cast<uint8_t*>(dst), outputStride, scratch);
+		}
+		else
+		{
+			memcpy(dst, rawFrame, imageSize);
+		}
+		batch->count++;
+	};
+
+	cout << "Appending images to video file... ";
 
-		for (int imageCnt = 0; imageCnt < images.size(); imageCnt++)
+	// Reading images from Binary
+	size_t framesRead = 0;
+	if (frameSlots == nullptr && !proxy)
+	{
+		// Full resolution frames are read straight into the batch
+		while (encoderResult == 0)
+		{
+			if (!rawFile.read(nextFrameBuffer(), imageSize))
+			{
+				break;
+			}
+			batch->count++;
+			framesRead++;
+		}
+	}
+	else if (frameSlots == nullptr)
+	{
+		vector<char> rawFrame(imageSize);
+		while (encoderResult == 0 && rawFile.read(rawFrame.data(), imageSize))
 		{
-			video.Append(images[imageCnt]);
+			appendFrame(rawFrame.data());
+			framesRead++;
 		}
+	}
+	else
+	{
+		ofstream retimeFile(videoFilename + "_retime.csv");
+		retimeFile << "Slot" << "," << "Action" << "," << "FrameID" << endl;
+
+		vector<char> currentFrame(imageSize);
+		vector<char> previousFrame(imageSize, 0);
+		int64_t nextSlot = 0;
+		int64_t slotsInserted = 0;
+		int64_t framesDropped = 0;
 
-		// Close video file
-		video.Close();
-		cout << " done!" << endl;
-		cout << "Video " << videoFilename << ".avi saved!"  << endl;
+		while (encoderResult == 0 && rawFile.read(currentFrame.data(), imageSize))
+		{
+			// Frames beyond the end of the log are appended on the following slot
+			int64_t slot = (framesRead < frameSlots->size()) ? (*frameSlots)[framesRead] : nextSlot;
+			uint64_t frameID = (framesRead < frameIDs->size()) ? (*frameIDs)[framesRead] : 0;
+			framesRead++;
+
+			// Frames without a session frame of their own, e.g. two frames on one trigger pulse
+			if (slot < nextSlot)
+			{
+				retimeFile << slot << "," << "dropped" << "," << frameID << endl;
+				framesDropped++;
+				continue;
+			}
+
+			// Fill missing slots before this frame
+			for (; nextSlot < slot; nextSlot++)
+			{
+				appendFrame(previousFrame.data());
+				retimeFile << nextSlot << "," << gapFill << "," << endl;
+				slotsInserted++;
+			}
+
+			appendFrame(currentFrame.data());
+			nextSlot++;
+
+			if (gapFill == "DUPLICATE")
+			{
+				swap(previousFrame, currentFrame);
+			}
+		}
+
+		// Pad the video to the common session length of all cameras
+		for (; nextSlot < sessionFrames && encoderResult == 0; nextSlot++)
+		{
+			appendFrame(previousFrame.data());
+			retimeFile << nextSlot << "," << gapFill << "," << endl;
+			slotsInserted++;
+		}
+
+		if (framesRead > frameSlots->size())
+		{
+			cout << endl << "Warning: " << framesRead - frameSlots->size() << " frames in binary file are missing in the logfile" << endl;
+		}
+		cout << endl << "Re-timed to " << nextSlot << " frames: " << slotsInserted << " slots inserted (" << gapFill << "), " << framesDropped << " frames dropped" << endl;
+		cout << "Retime report " << videoFilename << "_retime.csv saved" << endl;
 	}
-	catch (Spinnaker::Exception& e)
+
+	if (batch->count > 0)
+	{
+		buffer.PublishFull();
+	}
+	buffer.Finish();
+	encoderThread.join();
+
+	// Close the file
+	rawFile.close();
+
+	if (encoder->Close() != 0 || encoderResult != 0)
 	{
-		cout << "Error: " << e.what() << endl;
 		result = -1;
 	}
+
+	cout << " done!" << endl;
+	cout << "Retrieved images from Binary file: " << framesRead << endl;
+	cout << "Video " << videoFilename << " saved with " << framesEncoded << " frames!" << endl;
+
 	return result;
 }
 
 /*
 =================
-The function RetrieveImagesFromFiles loops over all files in filenames vector and retrieves chunks if imageSize from binary file. These chunks are conevrted into image structure and appended to images vector. The images vector is passed to the function SaveVectorToVideo and saved as AVI. Parameters imageHeight and imageWidth are hardcoded from previous recording settings.
+The class TileWorkers keeps one thread per mosaic tile. Run() starts the tile task on all threads for the next output frame and returns when every tile is done.
 =================
 */
-int RetrieveImagesFromFiles(vector<string>& filenames, int numFiles)
+class TileWorkers
 {
-	int result = 0;
-	int imageSize = imageHeight * imageWidth;
+public:
+	TileWorkers(int numTiles, function<void(int)> tileTask) : task(tileTask), generation(0), pending(0), stop(false)
+	{
+		for (int tile = 0; tile < numTiles; tile++)
+		{
+			workers.emplace_back([this, tile]()
+			{
+				uint64_t done = 0;
+				while (true)
+				{
+					{
+						unique_lock<mutex> lock(workMutex);
+						startCondition.wait(lock, [this, done] { return stop || generation != done; });
+						if (stop)
+						{
+							return;
+						}
+						done = generation;
+					}
+
+					task(tile);
+
+					lock_guard<mutex> lock(workMutex);
+					if (--pending == 0)
+					{
+						doneCondition.notify_one();
+					}
+				}
+			});
+		}
+	}
 
-	try {
-		// Loop through the binary filenames and retrieve images of imageSize
-		for (int fileCnt = 0; fileCnt < numFiles; fileCnt++)
+	~TileWorkers()
+	{
+		{
+			lock_guard<mutex> lock(workMutex);
+			stop = true;
+		}
+		startCondition.notify_all();
+		for (auto& worker : workers)
 		{
-			string tempFilename = filenames.at(fileCnt);
-			cout << endl << "*** READING BINARY FILE ***" << endl << endl;
-			cout << "Opening " << tempFilename.c_str() << "..." << endl;
+			worker.join();
+		}
+	}
 
-			ifstream rawFile(filenames.at(fileCnt).c_str(), ios_base::in | ios_base::binary);
+	void Run()
+	{
+		unique_lock<mutex> lock(workMutex);
+		pending = (int)workers.size();
+		generation++;
+		startCondition.notify_all();
+		doneCondition.wait(lock, [this] { return pending == 0; });
+	}
 
-			if (!rawFile)
-			{
-				cout << "Error opening file: " << filenames.at(fileCnt).c_str() << " Aborting..." << endl;
+private:
+	vector<thread> workers;
+	function<void(int)> task;
+	uint64_t generation;
+	int pending;
+	bool stop;
+	mutex workMutex;
+	condition_variable startCondition;
+	condition_variable doneCondition;
+};
 
-				return -1;
-			}
+/*
+=================
+The function ConvertFilesToMosaic combines the binary files of all cameras into one video. Each output frame tiles the frames of all cameras recorded on the same session frame (see AlignFiles), in MosaicColumns columns and downscaled by MosaicScale. Tiles are read, converted and downscaled in parallel, missing frames are filled according to GapFill.
+=================
+*/
+int ConvertFilesToMosaic(vector<string>& filenames, const vector<vector<int64_t>>& frameSlots, int64_t sessionFrames)
+{
+	cout << endl << "*** CONVERTING MOSAIC VIDEO ***" << endl << endl;
+
+	// Validate before any division by the mosaic settings
+	if (mosaicScale < 1 || mosaicScale > 16 || mosaicColumns < 1)
+	{
+		cout << "MosaicScale must be between 1 and 16 and MosaicColumns at least 1. Aborting..." << endl;
+		return -1;
+	}
+	if (filenames.empty())
+	{
+		cout << "No binary files to tile. Aborting..." << endl;
+		return -1;
+	}
+
+	int result = 0;
+	int numTiles = (int)filenames.size();
+	int columns = min(mosaicColumns, numTiles);
+	int rows = (numTiles + columns - 1) / columns;
+	int channels = (color == 1) ? 3 : 1;
+	PixelFormatEnums format = (color == 1) ? PixelFormat_BGR8 : PixelFormat_Mono8;
+
+	size_t imageSize = (size_t)imageHeight * imageWidth;
+	int tileWidth = imageWidth / mosaicScale;
+	int tileHeight = imageHeight / mosaicScale;
+	int mosaicWidth = columns * tileWidth;
+	int mosaicHeight = rows * tileHeight;
+	size_t tileStride = (size_t)tileWidth * channels;
+	size_t mosaicStride = (size_t)mosaicWidth * channels;
+	size_t mosaicSize = mosaicStride * mosaicHeight;
+
+	cout << "Tiling " << numTiles << " cameras in " << columns << " x " << rows << " tiles of " << tileWidth << " x " << tileHeight << endl;
+
+	// Per camera reading state, only touched by the thread of its tile
+	struct TileState
+	{
+		SegmentedFile rawFile;
+		size_t framesRead = 0;
+		int64_t nextFrameSlot = 0;
+		vector<char> rawFrame;
+		vector<uint8_t> tile;
+		vector<uint8_t> scratch;
+		int64_t slotsFilled = 0;
+	};
+	vector<TileState> tiles(numTiles);
+
+	for (int tileCnt = 0; tileCnt < numTiles; tileCnt++)
+	{
+		TileState& state = tiles[tileCnt];
+		state.rawFile.open(filenames[tileCnt], ios_base::in | ios_base::binary);
+		if (!state.rawFile)
+		{
+			cout << "Error opening file: " << filenames[tileCnt] << " Aborting..." << endl;
+			return -1;
+		}
+		state.rawFrame.resize(imageSize);
+		state.tile.assign(tileStride * tileHeight, 0);
+		state.nextFrameSlot = frameSlots[tileCnt].empty() ? 0 : frameSlots[tileCnt][0];
+		cout << "Tile " << tileCnt << ": " << filenames[tileCnt] << endl;
+	}
 
-			cout << "Splitting images...";
+	// FILENAME
+	string firstFilename = filenames[0];
+	string videoFilename = path + firstFilename.substr(3, firstFilename.length() - 7) + "_mosaic";
 
-			// Save acquired images into images vector
-			vector<ImagePtr> images;
+	unique_ptr<VideoEncoder> encoder = CreateEncoder();
+	if (encoder->Open(videoFilename, mosaicWidth, mosaicHeight, format) != 0)
+	{
+		return -1;
+	}
 
-			// Binary video recordings get very large and may not fit in RAM read file and write video in steps
-			int frameCnt = 0;
-			int part = 1;
+	FrameDoubleBuffer buffer(mosaicSize, batchSize);
+	atomic<int> encoderResult(0);
 
-			while (rawFile.good())
+	thread encoderThread([&]()
+	{
+		FrameBatch* batch;
+		while ((batch = buffer.AcquireFull()) != nullptr)
+		{
+			for (size_t frameCnt = 0; frameCnt < batch->count && encoderResult == 0; frameCnt++)
 			{
-				// Split binary reading in case .tmp is too large for memory
-				if (frameCnt > 5000)
-				{
-					// Saving images from split above
-					cout << "Retrieved images from Binary file: " << images.size() << endl;
-
-					// start converting image vector into avi for fileCnt loop
-					result = SaveVectorToVideo(tempFilename, images, part);
+				encoderResult = encoder->Append(&batch->data[frameCnt * mosaicSize]);
+			}
+			buffer.ReleaseEmpty();
+		}
+	});
 
-					// reset for next batch
-					images.clear();
-					frameCnt = 0;
-					part++;
-				}
+	// The tile task renders the frame of its camera for the current slot into the current mosaic frame
+	int64_t slot = 0;
+	uint8_t* mosaicFrame = nullptr;
 
-				// Reading images from Binary
-				char* imageBuffer = new char[imageSize];
+	TileWorkers workers(numTiles, [&](int tileCnt)
+	{
+		TileState& state = tiles[tileCnt];
+		const vector<int64_t>& slots = frameSlots[tileCnt];
+		bool found = false;
 
-				rawFile.read(imageBuffer, imageSize);
+		// Skip frames that share an earlier slot and read the frame recorded on this slot
+		while (state.rawFile && state.nextFrameSlot <= slot)
+		{
+			bool onSlot = (state.nextFrameSlot == slot);
+			if (!state.rawFile.read(state.rawFrame.data(), imageSize))
+			{
+				break;
+			}
+			state.framesRead++;
+			state.nextFrameSlot = (state.framesRead < slots.size()) ? slots[state.framesRead] : state.nextFrameSlot + 1;
+			if (onSlot)
+			{
+				found = true;
+				break;
+			}
+		}
 
-				if (color == 1)
+		if (found)
+		{
+			try
+			{
+				if (color == 1 && mosaicScale % 2 == 0)
 				{
-					// Import binary image into BayerRG8 Image structure
-					ImagePtr pImage = Image::Create(imageWidth, imageHeight, 0, 0, PixelFormat_BayerRG8, imageBuffer);
-
-					// Deep copy image into BayerRG8 image vector
-					images.push_back(pImage->Convert(PixelFormat_BayerRG8, HQ_LINEAR));
+					ProxyDownscale(reinterpret_cast<uint8_t*>(state.rawFrame.data()), imageWidth, imageHeight, true, mosaicScale, state.tile.data(), tileStride, state.scratch);
+				}
+				else if (color == 1)
+				{
+					ImagePtr pImage = Image::Create(imageWidth, imageHeight, 0, 0, PixelFormat_BayerRG8, state.rawFrame.data());
+					ImagePtr pConverted = pImage->Convert(PixelFormat_BGR8, HQ_LINEAR);
+					BoxDownscale(static_cast<uint8_t*>(pConverted->GetData()), imageWidth, imageHeight, 3, mosaicScale, state.tile.data(), tileStride);
 				}
 				else
 				{
-					// Import binary image into Mono8 Image structure
-					ImagePtr pImage = Image::Create(imageWidth, imageHeight, 0, 0, PixelFormat_Mono8, imageBuffer);
-
-					// Deep copy image into Mono8 image vector
-					images.push_back(pImage->Convert(PixelFormat_Mono8, HQ_LINEAR));
+					BoxDownscale(reinterpret_cast<uint8_t*>(state.rawFrame.data()), imageWidth, imageHeight, 1, mosaicScale, state.tile.data(), tileStride);
 				}
-
-				// Delete the acquired buffer
-				delete[] imageBuffer;
-
-				// update frame counter
-				frameCnt++;
 			}
+			catch (Spinnaker::Exception& e)
+			{
+				cout << "Error: " << e.what() << endl;
+				encoderResult = -1;
+			}
+		}
+		else
+		{
+			state.slotsFilled++;
+			if (gapFill != "DUPLICATE")
+			{
+				fill(state.tile.begin(), state.tile.end(), 0);
+			}
+		}
 
-			// Saving rest images from last split 
-			cout << "Retrieved images from Binary file: " << images.size() << endl;
+		// Copy tile into its place in the mosaic
+		uint8_t* dst = mosaicFrame + (size_t)(tileCnt / columns) * tileHeight * mosaicStride + (size_t)(tileCnt % columns) * tileStride;
+		for (int y = 0; y < tileHeight; y++)
+		{
+			memcpy(dst + y * mosaicStride, &state.tile[y * tileStride], tileStride);
+		}
+	});
 
-			// start converting image vector into avi for fileCnt loop
-			result = SaveVectorToVideo(tempFilename, images, part);
+	cout << "Appending " << sessionFrames << " mosaic frames to video file... ";
 
-			// Close the file
-			cout << "Closing binary file" << endl;
-			rawFile.close();
+	FrameBatch* batch = buffer.AcquireEmpty();
+	for (slot = 0; slot < sessionFrames && encoderResult == 0; slot++)
+	{
+		if (batch->count == (size_t)batchSize)
+		{
+			buffer.PublishFull();
+			batch = buffer.AcquireEmpty();
+		}
+		mosaicFrame = reinterpret_cast<uint8_t*>(&batch->data[batch->count * mosaicSize]);
+
+		// empty grid cells stay black
+		if (numTiles < columns * rows)
+		{
+			memset(mosaicFrame, 0, mosaicSize);
 		}
+
+		workers.Run();
+		batch->count++;
+	}
+	if (batch->count > 0)
+	{
+		buffer.PublishFull();
+	}
+	buffer.Finish();
+	encoderThread.join();
+
+	if (encoder->Close() != 0 || encoderResult != 0)
+	{
+		result = -1;
 	}
-	catch (Spinnaker::Exception& e)
+
+	cout << " done!" << endl;
+	for (int tileCnt = 0; tileCnt < numTiles; tileCnt++)
+	{
+		cout << "Tile " << tileCnt << ": " << tiles[tileCnt].framesRead << " frames read, " << tiles[tileCnt].slotsFilled << " slots filled (" << gapFill << ")" << endl;
+	}
+	cout << "Video " << videoFilename << " saved with " << slot << " frames!" << endl;
+
+	return result;
+}
+
+/*
+=================
+The function RetrieveImagesFromFiles loops over all files in filenames vector and converts each binary file with ConvertFileToVideo. Parameters imageHeight and imageWidth are hardcoded from previous recording settings.
+With RetimeLog or SyncTable set, all files are aligned first, so that every video is padded to the same number of session frames.
+=================
+*/
+int RetrieveImagesFromFiles(vector<string>& filenames, int numFiles)
+{
+	int result = 0;
+
+	if (TestWritePermission() != 0)
 	{
-		cout << "Error: " << e.what() << endl;
 		return -1;
 	}
+
+	vector<vector<uint64_t>> frameIDs(numFiles);
+	vector<vector<int64_t>> frameSlots(numFiles);
+	int64_t sessionFrames = 0;
+
+	// The area filter averages at most 16 x 16 pixels, color proxies are halved by the Bayer superpixel first
+	int maxProxyScale = (color == 1) ? 32 : 16;
+	if (proxyScale < 1 || proxyScale > maxProxyScale || (color == 1 && proxyScale > 1 && proxyScale % 2 != 0))
+	{
+		cout << "ProxyScale must be between 1 and " << maxProxyScale << ", and even for color videos. Aborting..." << endl;
+		return -1;
+	}
+
+	bool aligned = !retimeLog.empty() || !syncTable.empty();
+	if (mosaic == 1 && !aligned)
+	{
+		cout << "Mosaic export aligns frames by the logfile, set RetimeLog or SyncTable in the metadata file. Aborting..." << endl;
+		return -1;
+	}
+
+	if (aligned)
+	{
+		cout << endl << "*** ALIGNING FRAMES ***" << endl << endl;
+
+		if (AlignFiles(filenames, frameSlots, frameIDs, sessionFrames) != 0)
+		{
+			return -1;
+		}
+		for (int fileCnt = 0; fileCnt < numFiles; fileCnt++)
+		{
+			cout << "Camera [" << SerialFromFilename(filenames.at(fileCnt)) << "]: " << frameSlots[fileCnt].size() << " frames logged" << endl;
+		}
+		cout << "All videos are re-timed to " << sessionFrames << " frames at " << frameRateToSet << " FPS" << endl;
+	}
+
+	if (mosaic == 1)
+	{
+		return ConvertFilesToMosaic(filenames, frameSlots, sessionFrames);
+	}
+
+	// Loop through the binary filenames and convert each into a video
+	for (int fileCnt = 0; fileCnt < numFiles; fileCnt++)
+	{
+		if (!aligned)
+		{
+			result |= ConvertFileToVideo(filenames.at(fileCnt), nullptr, nullptr, 0);
+		}
+		else
+		{
+			result |= ConvertFileToVideo(filenames.at(fileCnt), &frameSlots[fileCnt], &frameIDs[fileCnt], sessionFrames);
+		}
+	}
 	return result;
 }
 
 
 /*
 =================
- Entry point
+ Entry point. Called without arguments the program asks for the metadata and binary files. Called as
+ BINtoAVI <metadata> <file1+file2+...> [background] it converts without prompts, e.g. when started by RECtoBIN
+ for finished recording segments. With background the process lowers its CPU and I/O priority.
 =================
 */
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
 	int result = 0;
+	bool interactive = argc < 3;
 
 	// Print application build information
 	cout << "*************************************************************" << endl;
@@ -303,10 +1326,33 @@ int main(int /*argc*/, char** /*argv*/)
 	cout << "MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com" << endl;
 	cout << "*************************************************************" << endl;
 
+	if (argc > 3 && string(argv[3]) == "background")
+	{
+#if defined(_WIN32)
+		SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN);
+#else
+		setpriority(PRIO_PROCESS, 0, 19);
+#if defined(__linux__)
+		// Idle I/O class, glibc has no wrapper for ioprio_set: class 3 shifted by 13 bits, for this process (who 1, id 0)
+		if (syscall(SYS_ioprio_set, 1, 0, 3 << 13) != 0)
+		{
+			cout << "Warning: unable to lower the I/O priority!" << endl;
+		}
+#endif
+#endif
+	}
+
 	// Ask for metadata first to update config parameters
 	string metadata;
-	cout << endl << "Enter the METADATA file of the specific recording to convert: " << endl;
-	getline(cin, metadata);
+	if (interactive)
+	{
+		cout << endl << "Enter the METADATA file of the specific recording to convert: " << endl;
+		getline(cin, metadata);
+	}
+	else
+	{
+		metadata = argv[1];
+	}
 	cout << endl << "Setting parameters from " + metadata + " ... " << endl;
 
 	// Set configuration parameters
@@ -315,8 +1361,15 @@ int main(int /*argc*/, char** /*argv*/)
 	// Manual input of Binary filenames to be converted
 	vector<string> filenames = {};
 	string S, T;
-	cout << endl << "Enter the BINARY files to convert separated by a + sign: " << endl;
-	getline(cin, S); // read entire line
+	if (interactive)
+	{
+		cout << endl << "Enter the BINARY files (.tmp, or .idx for segmented recordings) to convert separated by a + sign: " << endl;
+		getline(cin, S); // read entire line
+	}
+	else
+	{
+		S = argv[2];
+	}
 	stringstream X(S);
 
 	while (getline(X, T, '+')) { //separate input by + separator
@@ -331,22 +1384,29 @@ int main(int /*argc*/, char** /*argv*/)
 		cout << filenames[files] << endl;
 	}
 
-	cout << endl << "Press Enter to convert files" << endl << endl;
-	getchar(); // pass filenames vector to RetrieveImagesFromFiles
+	if (interactive)
+	{
+		cout << endl << "Press Enter to convert files" << endl << endl;
+		getchar(); // pass filenames vector to RetrieveImagesFromFiles
+	}
 
 
 	// Retrieve images from .tmp file
 	result = RetrieveImagesFromFiles(filenames, numFiles);
 
 
-	cout << endl << "Conversion complete! Press Enter to exit..." << endl;
+	cout << endl << "Conversion complete!" << endl;
 
 	// Print application build information
 	cout << "*************************************************************" << endl;
 	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
 	cout << "MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com" << endl;
 	cout << "*************************************************************" << endl;
-	getchar();
+	if (interactive)
+	{
+		cout << "Press Enter to exit..." << endl;
+		getchar();
+	}
 
 	return result;
 }
@@ -0,0 +1,132 @@
+/*
+====================================================================================================
+This header contains the USB bandwidth planner of RECtoBIN. Cameras on the same USB3 host controller
+share its bandwidth, so a recording that fits every single camera link can still lose frames once all
+cameras stream together. PlanBandwidth groups the cameras by host controller, compares the bytes per
+second each camera needs (width x height x pixel size x FPS) with the controller budget and gives
+every camera a DeviceLinkThroughputLimit: its own need plus a share of the spare bandwidth in
+proportion to that need, capped by the camera link. The planner does not touch the cameras, so it can
+be tried offline with made-up cameras.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+
+struct BandwidthCamera
+{
+	std::string serial;
+	std::string controller; // cameras with the same controller share its bandwidth
+	double required = 0; // bytes per second of the recording
+	double limitMin = 0; // range of DeviceLinkThroughputLimit in bytes per second
+	double limitMax = 0;
+	double limit = 0; // planned DeviceLinkThroughputLimit
+};
+
+struct BandwidthController
+{
+	std::string name;
+	int cameras = 0;
+	double required = 0;
+	double allocated = 0;
+	bool feasible = true;
+};
+
+/*
+=================
+The function RequiredBandwidth returns the bytes per second of one camera. Packed formats count fractional bytes, e.g. 12 bits per pixel are 1.5 bytes.
+=================
+*/
+inline double RequiredBandwidth(int width, int height, int bitsPerPixel, double frameRate)
+{
+	return (double)width * height * bitsPerPixel / 8.0 * frameRate;
+}
+
+/*
+=================
+The function PlanBandwidth sets the limit of every camera and returns one summary per host controller. A controller is infeasible when its cameras need more than controllerBandwidth together, a camera when it needs more than its link allows or its limit would leave less than headroom on top of its need. It returns 0 if all controllers are feasible and -1 otherwise. Limits are planned for infeasible controllers as well, each camera then gets its share of the budget.
+=================
+*/
+inline int PlanBandwidth(std::vector<BandwidthCamera>& cameras, double controllerBandwidth, double headroom, std::vector<BandwidthController>& controllers)
+{
+	controllers.clear();
+	for (BandwidthCamera& camera : cameras)
+	{
+		auto controller = std::find_if(controllers.begin(), controllers.end(), [&](const BandwidthController& c) { return c.name == camera.controller; });
+		if (controller == controllers.end())
+		{
+			controllers.push_back(BandwidthController());
+			controllers.back().name = camera.controller;
+			controller = controllers.end() - 1;
+		}
+		controller->cameras++;
+		controller->required += camera.required;
+	}
+
+	int result = 0;
+	for (BandwidthController& controller : controllers)
+	{
+		double spare = controllerBandwidth - controller.required;
+		for (BandwidthCamera& camera : cameras)
+		{
+			if (camera.controller != controller.name)
+			{
+				continue;
+			}
+
+			// Own need plus a share of the spare bandwidth, or a share of the budget if there is none
+			double share = (controller.required > 0) ? camera.required / controller.required : 1.0 / controller.cameras;
+			double limit = (spare >= 0) ? camera.required + spare * share : controllerBandwidth * share;
+			if (camera.limitMax > 0)
+			{
+				limit = std::min(limit, camera.limitMax);
+			}
+			camera.limit = std::max(limit, camera.limitMin);
+			controller.allocated += camera.limit;
+
+			if (camera.limit < camera.required * (1.0 + headroom))
+			{
+				controller.feasible = false;
+			}
+		}
+		if (spare < 0)
+		{
+			controller.feasible = false;
+		}
+		if (!controller.feasible)
+		{
+			result = -1;
+		}
+	}
+	return result;
+}
+
+/*
+=================
+The function ReportBandwidthPlan prints the plan as a table in MB/s, one row per camera followed by one row per host controller.
+=================
+*/
+inline void ReportBandwidthPlan(const std::vector<BandwidthCamera>& cameras, const std::vector<BandwidthController>& controllers, double controllerBandwidth, std::ostream& out)
+{
+	const double MB = 1024.0 * 1024.0;
+	out << "Serial\t\tController\tRequired\tLimit [MB/s]" << std::endl;
+	for (const BandwidthCamera& camera : cameras)
+	{
+		out << camera.serial << "\t" << camera.controller << "\t" << camera.required / MB << "\t\t" << camera.limit / MB
+			<< (camera.limit < camera.required ? "\tOVERBOOKED" : "") << std::endl;
+	}
+	for (const BandwidthController& controller : controllers)
+	{
+		out << "Controller " << controller.name << ": " << controller.cameras << " cameras need " << controller.required / MB << " of "
+			<< controllerBandwidth / MB << " MB/s (" << 100.0 * controller.required / controllerBandwidth << "%)"
+			<< (controller.feasible ? "" : ", NOT FEASIBLE") << std::endl;
+	}
+}
@@ -0,0 +1,116 @@
+/*
+====================================================================================================
+This program tests the USB bandwidth planner of BandwidthPlan.h offline with made-up cameras, no
+camera or Spinnaker SDK is needed. It covers a feasible and an infeasible host controller, two
+controllers planned independently, limits capped by the camera link and the headroom check, prints
+the plan of each case and returns 0 if all tests passed. Start it with: BandwidthPlanTest
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#include "BandwidthPlan.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+const double MB = 1024.0 * 1024.0;
+int failedChecks = 0;
+
+/*
+=================
+The function Check reports one expectation of a test and counts the failed ones. Near compares bandwidths within 1 byte per second, Camera makes up one camera with its need and link limit in MB/s.
+=================
+*/
+void Check(bool passed, const string& expectation)
+{
+	cout << (passed ? "  ok      " : "  FAILED  ") << expectation << endl;
+	if (!passed)
+	{
+		failedChecks++;
+	}
+}
+
+bool Near(double value, double expected)
+{
+	return fabs(value - expected) < 1.0;
+}
+
+BandwidthCamera Camera(const string& serial, const string& controller, double requiredMB, double limitMaxMB = 0)
+{
+	BandwidthCamera camera;
+	camera.serial = serial;
+	camera.controller = controller;
+	camera.required = requiredMB * MB;
+	camera.limitMax = limitMaxMB * MB;
+	return camera;
+}
+
+/*
+=================
+The function RunPlan plans cameras on controllers of controllerMB and prints the plan like RECtoBIN does.
+=================
+*/
+int RunPlan(const string& title, vector<BandwidthCamera>& cameras, double controllerMB, double headroom, vector<BandwidthController>& controllers)
+{
+	cout << endl << "*** " << title << " ***" << endl << endl;
+	int result = PlanBandwidth(cameras, controllerMB * MB, headroom, controllers);
+	ReportBandwidthPlan(cameras, controllers, controllerMB * MB, cout);
+	cout << endl;
+	return result;
+}
+
+/*
+=================
+This is the Entry point for the program. Every test builds its cameras, plans them and checks the limits and the feasibility of the plan.
+=================
+*/
+int main()
+{
+	cout << "*************************************************************" << endl;
+	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
+	cout << "MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com" << endl;
+	cout << "*************************************************************" << endl;
+
+	vector<BandwidthController> controllers;
+
+	// Two cameras that fit, the spare bandwidth is shared in proportion to their need
+	vector<BandwidthCamera> feasible = { Camera("A1", "ctrl0", 100), Camera("A2", "ctrl0", 50) };
+	int result = RunPlan("FEASIBLE CONTROLLER", feasible, 380, 0.1, controllers);
+	Check(result == 0, "plan is feasible");
+	Check(controllers.size() == 1 && controllers[0].feasible, "controller is feasible");
+	Check(Near(feasible[0].limit, (100 + 230 * 2.0 / 3.0) * MB), "A1 gets its need plus 2/3 of the spare bandwidth");
+	Check(Near(feasible[1].limit, (50 + 230 / 3.0) * MB), "A2 gets its need plus 1/3 of the spare bandwidth");
+	Check(Near(controllers[0].allocated, 380 * MB), "the whole controller budget is allocated");
+
+	// Three cameras that need more than the controller has, each gets a share of the budget
+	vector<BandwidthCamera> infeasible = { Camera("B1", "ctrl0", 150), Camera("B2", "ctrl0", 150), Camera("B3", "ctrl0", 150) };
+	result = RunPlan("INFEASIBLE CONTROLLER", infeasible, 380, 0.1, controllers);
+	Check(result == -1, "plan is infeasible");
+	Check(controllers.size() == 1 && !controllers[0].feasible, "controller is infeasible");
+	Check(Near(infeasible[0].limit, 380 / 3.0 * MB) && Near(infeasible[2].limit, 380 / 3.0 * MB), "every camera gets a third of the budget");
+
+	// Controllers are planned independently, one overbooked controller does not change the other
+	vector<BandwidthCamera> twoControllers = { Camera("C1", "ctrl0", 120), Camera("C2", "ctrl1", 250), Camera("C3", "ctrl1", 250), Camera("C4", "ctrl0", 120) };
+	result = RunPlan("TWO CONTROLLERS", twoControllers, 380, 0.1, controllers);
+	Check(result == -1, "plan is infeasible because of one controller");
+	Check(controllers.size() == 2 && controllers[0].name == "ctrl0" && controllers[0].cameras == 2 && Near(controllers[0].required, 240 * MB), "ctrl0 sums its own two cameras");
+	Check(controllers.size() == 2 && controllers[0].feasible && !controllers[1].feasible, "ctrl0 is feasible, ctrl1 is not");
+	Check(Near(twoControllers[0].limit, 190 * MB) && Near(twoControllers[3].limit, 190 * MB), "ctrl0 cameras share ctrl0 only");
+	Check(Near(twoControllers[1].limit, 190 * MB) && Near(twoControllers[2].limit, 190 * MB), "ctrl1 cameras share ctrl1 only");
+
+	// A slow camera link caps the limit, the headroom check then fails for that camera
+	vector<BandwidthCamera> linkCap = { Camera("D1", "ctrl0", 100, 105), Camera("D2", "ctrl0", 50, 400) };
+	result = RunPlan("CAMERA LINK CAP", linkCap, 380, 0.1, controllers);
+	Check(Near(linkCap[0].limit, 105 * MB), "D1 is capped by its link");
+	Check(result == -1 && !controllers[0].feasible, "10% headroom does not fit into the capped link");
+	result = RunPlan("CAMERA LINK CAP WITHOUT HEADROOM", linkCap, 380, 0.0, controllers);
+	Check(result == 0 && controllers[0].feasible, "without headroom the capped link is enough");
+
+	cout << endl << (failedChecks == 0 ? "All tests passed" : to_string(failedChecks) + " checks failed") << endl;
+	return failedChecks == 0 ? 0 : -1;
+}
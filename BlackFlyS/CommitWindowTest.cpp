@@ -0,0 +1,175 @@
+/*
+====================================================================================================
+This program tests the commit windows of CommitWindows.h offline with made-up frames, no camera or
+Spinnaker SDK is needed. It replays the pre-trigger ring of two cameras frame by frame, one ring
+writer keeps up with the cameras and one is slower than the cameras, like a slow disk. Two trigger
+events further apart than preTriggerSeconds plus postTriggerSeconds must both end up complete in the
+files of both cameras, even though the slow writer is still saving the first event when the second
+one arrives. It returns 0 if all tests passed. Start it with: CommitWindowTest
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#include "CommitWindows.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+
+using namespace std;
+
+int failedChecks = 0;
+
+/*
+=================
+The function Check reports one expectation of a test and counts the failed ones.
+=================
+*/
+void Check(bool passed, const string& expectation)
+{
+	cout << (passed ? "  ok      " : "  FAILED  ") << expectation << endl;
+	if (!passed)
+	{
+		failedChecks++;
+	}
+}
+
+/*
+=================
+The struct Writer replays one ring writer. Every grabbed frame gives it ticksPerCommit-th of the time to write one frame, dropped frames take no time. The frames it commits are collected in committed.
+=================
+*/
+struct Writer
+{
+	size_t index = 0;
+	int ticksPerCommit = 1;
+	int64_t tail = 0; // next frame in the ring
+	int budget = 0;
+	set<int64_t> committed;
+
+	void Run(CommitWindows& windows, int64_t head, int64_t holdFrames, bool closing)
+	{
+		budget++;
+		while (tail < head)
+		{
+			commitDecision decision = windows.Decide(index, tail, head - 1, holdFrames, closing);
+			if (decision == HOLD)
+			{
+				return;
+			}
+			if (decision == COMMIT)
+			{
+				if (budget < ticksPerCommit && !closing)
+				{
+					return;
+				}
+				budget = 0;
+				committed.insert(tail);
+			}
+			tail++;
+		}
+	}
+};
+
+/*
+=================
+The function Replay grabs frames 0 to frames-1 on both cameras, opens a window at every event frame and runs the writers after every frame, then closes the rings and lets the writers finish.
+=================
+*/
+void Replay(CommitWindows& windows, vector<Writer>& writers, int64_t frames, const vector<int64_t>& events, int64_t preFrames, int64_t postFrames)
+{
+	const int64_t holdFrames = preFrames + 2;
+	windows.Reset(writers.size());
+	for (Writer& writer : writers)
+	{
+		windows.Join(writer.index);
+	}
+
+	for (int64_t head = 1; head <= frames; head++)
+	{
+		for (int64_t event : events)
+		{
+			if (event == head - 1)
+			{
+				windows.Open(event, preFrames, postFrames);
+			}
+		}
+		for (Writer& writer : writers)
+		{
+			writer.Run(windows, head, holdFrames, false);
+		}
+	}
+	for (Writer& writer : writers)
+	{
+		writer.Run(windows, frames, holdFrames, true);
+		windows.Leave(writer.index);
+	}
+}
+
+bool CommittedExactly(const Writer& writer, const vector<int64_t>& events, int64_t preFrames, int64_t postFrames)
+{
+	set<int64_t> expected;
+	for (int64_t event : events)
+	{
+		for (int64_t frame = event - preFrames; frame <= event + postFrames; frame++)
+		{
+			expected.insert(frame);
+		}
+	}
+	return writer.committed == expected;
+}
+
+/*
+=================
+This is the Entry point for the program. Every test replays one recording and checks the committed frames of each writer.
+=================
+*/
+int main()
+{
+	cout << "*************************************************************" << endl;
+	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
+	cout << "MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com" << endl;
+	cout << "*************************************************************" << endl;
+
+	// 100 FPS, 1 s before and 1 s after each event
+	const int64_t preFrames = 100;
+	const int64_t postFrames = 100;
+	CommitWindows windows;
+
+	cout << endl << "*** TWO SEPARATED EVENTS, ONE WRITER SLOWER THAN THE CAMERAS ***" << endl << endl;
+	vector<Writer> writers(2);
+	writers[0].index = 0;
+	writers[1].index = 1;
+	writers[1].ticksPerCommit = 3;
+	vector<int64_t> events = { 300, 700 };
+	Replay(windows, writers, 1500, events, preFrames, postFrames);
+	Check(CommittedExactly(writers[0], events, preFrames, postFrames), "fast writer saved both events completely");
+	Check(CommittedExactly(writers[1], events, preFrames, postFrames), "slow writer saved both events completely");
+	Check(windows.Pending() == 0, "all windows are removed once both writers passed them");
+
+	cout << endl << "*** OVERLAPPING EVENTS ARE MERGED ***" << endl << endl;
+	writers = vector<Writer>(2);
+	writers[0].index = 0;
+	writers[1].index = 1;
+	writers[1].ticksPerCommit = 2;
+	events = { 300, 420 };
+	Replay(windows, writers, 1000, events, preFrames, postFrames);
+	Check(CommittedExactly(writers[0], events, preFrames, postFrames), "fast writer saved frames 200 to 520");
+	Check(CommittedExactly(writers[1], events, preFrames, postFrames), "slow writer saved frames 200 to 520");
+
+	cout << endl << "*** EVENTS OUT OF ORDER ***" << endl << endl;
+	windows.Reset(1);
+	windows.Join(0);
+	windows.Open(700, preFrames, postFrames);
+	windows.Open(300, preFrames, postFrames);
+	Check(windows.Pending() == 2, "an earlier event is kept next to a later one");
+	Check(windows.Decide(0, 250, 260, preFrames + 2, false) == COMMIT, "frame 250 of the earlier event is committed");
+	Check(windows.Decide(0, 450, 460, preFrames + 2, false) == HOLD, "frame 450 between the events is held");
+	Check(windows.Decide(0, 450, 600, preFrames + 2, false) == DROP, "frame 450 is dropped once it is out of reach");
+	Check(windows.Pending() == 1, "the earlier window is removed once the writer passed it");
+
+	cout << endl << (failedChecks == 0 ? "All tests passed" : to_string(failedChecks) + " checks failed") << endl;
+	return failedChecks == 0 ? 0 : -1;
+}
@@ -0,0 +1,138 @@
+/*
+====================================================================================================
+This header contains the commit windows of the pre-trigger ring of RECtoBIN. Every trigger event
+opens a window of FrameIDs, from preTriggerSeconds before until postTriggerSeconds after the event,
+and the ring writers of all cameras commit the frames inside any open window. Windows are kept in
+order until the writers of all cameras have passed their end, so a second event that arrives while
+a writer is still saving the first one, e.g. because the disk is slower than the cameras, does not
+cut the first one short. The windows do not touch the cameras, so they can be tried offline with
+made-up frames.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <limits>
+#include <algorithm>
+
+enum commitDecision
+{
+	COMMIT,
+	DROP,
+	HOLD
+};
+
+struct CommitWindow
+{
+	int64_t from = 0;
+	int64_t until = -1;
+};
+
+/*
+=================
+The class CommitWindows holds the pending windows in FrameIDs and the frame each ring writer decides on next. Reset prepares the table for the given number of ring writers, Join and Leave mark a writer as running or finished. Open adds the window of one event, windows that overlap or touch are merged. Decide tells a writer what to do with its oldest frame: frames inside a pending window are committed, frames more than holdFrames behind the last grabbed frame of the camera can not be reached by a later event and are dropped, younger frames are held in the ring. Once the grab thread has finished, frames outside all windows are dropped right away. A window is removed once every running writer has passed its end.
+=================
+*/
+class CommitWindows
+{
+public:
+	void Reset(size_t writers)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		windows.clear();
+		writerFrames.assign(writers, std::numeric_limits<int64_t>::max());
+	}
+
+	void Join(size_t writer)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		writerFrames[writer] = std::numeric_limits<int64_t>::min();
+	}
+
+	void Leave(size_t writer)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		writerFrames[writer] = std::numeric_limits<int64_t>::max();
+	}
+
+	void Open(int64_t eventFrame, int64_t preFrames, int64_t postFrames)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		CommitWindow window;
+		window.from = eventFrame - preFrames;
+		window.until = eventFrame + postFrames;
+
+		// Keep the windows sorted, events of the gate and of trigger commands can arrive slightly out of order
+		std::deque<CommitWindow>::iterator position = windows.end();
+		while (position != windows.begin() && (position - 1)->from > window.from)
+		{
+			--position;
+		}
+		windows.insert(position, window);
+
+		// Merge windows that overlap or touch
+		for (size_t i = 1; i < windows.size();)
+		{
+			if (windows[i].from <= windows[i - 1].until + 1)
+			{
+				windows[i - 1].until = std::max(windows[i - 1].until, windows[i].until);
+				windows.erase(windows.begin() + i);
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	commitDecision Decide(size_t writer, int64_t frameID, int64_t lastGrabFrameID, int64_t holdFrames, bool closing)
+	{
+		bool inWindow = false;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			writerFrames[writer] = frameID; // all earlier frames of this writer are decided
+
+			int64_t oldest = *std::min_element(writerFrames.begin(), writerFrames.end());
+			while (!windows.empty() && windows.front().until < oldest)
+			{
+				windows.pop_front();
+			}
+			for (const CommitWindow& window : windows)
+			{
+				if (frameID >= window.from && frameID <= window.until)
+				{
+					inWindow = true;
+					break;
+				}
+			}
+		}
+
+		if (inWindow)
+		{
+			return COMMIT;
+		}
+		if (closing || frameID < lastGrabFrameID - holdFrames)
+		{
+			return DROP;
+		}
+		return HOLD;
+	}
+
+	size_t Pending()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return windows.size();
+	}
+
+private:
+	std::mutex lock;
+	std::deque<CommitWindow> windows;
+	std::vector<int64_t> writerFrames;
+};
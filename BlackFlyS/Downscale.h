@@ -0,0 +1,209 @@
+/*
+====================================================================================================
+This header contains the image downscaling routines shared by the syncFLIR tools. BoxDownscale
+averages factor x factor pixel blocks (area filter) of 8 bit images with any number of interleaved
+channels. BayerSuperpixel and ProxyDownscale reduce BayerRG8 frames to BGR8 without a full resolution
+demosaicing step. MeanAbsDifference compares two small frames for motion detection. The inner loops
+run on SSE2 when available and fall back to plain C++ otherwise.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SYNCFLIR_SSE2 1
+#endif
+
+/*
+=================
+The function AccumulateRow adds one row of 8 bit values to a row of 16 bit sums. With SSE2 16 values are widened and added per step.
+=================
+*/
+inline void AccumulateRow(const uint8_t* src, uint16_t* rowSum, size_t count)
+{
+	size_t i = 0;
+#ifdef SYNCFLIR_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i sumLow = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowSum + i));
+		__m128i sumHigh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowSum + i + 8));
+		sumLow = _mm_add_epi16(sumLow, _mm_unpacklo_epi8(pixels, zero));
+		sumHigh = _mm_add_epi16(sumHigh, _mm_unpackhi_epi8(pixels, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rowSum + i), sumLow);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rowSum + i + 8), sumHigh);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		rowSum[i] += src[i];
+	}
+}
+
+/*
+=================
+The function BoxDownscale reduces an 8 bit image of width x height pixels with interleaved channels by an integer factor. Each output pixel is the rounded mean of a factor x factor block, remaining rows and columns at the border are cut off. dstStride is the row pitch of the output in bytes, so tiles can be written directly into a larger frame.
+=================
+*/
+inline void BoxDownscale(const uint8_t* src, int width, int height, int channels, int factor, uint8_t* dst, size_t dstStride)
+{
+	const int dstWidth = width / factor;
+	const int dstHeight = height / factor;
+	const size_t rowLength = (size_t)width * channels;
+	const uint32_t area = (uint32_t)factor * factor;
+
+	if (factor == 1)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			std::copy(src + y * rowLength, src + (y + 1) * rowLength, dst + y * dstStride);
+		}
+		return;
+	}
+
+	// factor is limited to 16 so that a column sum of factor rows fits into 16 bit
+	std::vector<uint16_t> rowSum(rowLength);
+
+	for (int y = 0; y < dstHeight; y++)
+	{
+		std::fill(rowSum.begin(), rowSum.end(), 0);
+		for (int k = 0; k < factor; k++)
+		{
+			AccumulateRow(src + ((size_t)y * factor + k) * rowLength, rowSum.data(), rowLength);
+		}
+
+		uint8_t* dstRow = dst + y * dstStride;
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const uint16_t* block = rowSum.data() + (size_t)x * factor * channels;
+			for (int c = 0; c < channels; c++)
+			{
+				uint32_t sum = 0;
+				for (int k = 0; k < factor; k++)
+				{
+					sum += block[k * channels + c];
+				}
+				dstRow[x * channels + c] = (uint8_t)((sum + area / 2) / area);
+			}
+		}
+	}
+}
+
+/*
+=================
+The function BayerSuperpixel demosaics and halves a BayerRG8 image in one pass. Every 2x2 RGGB block becomes one BGR8 pixel with R and B taken from their sites and G the mean of both green sites. With SSE2 16 output pixels are computed per step.
+=================
+*/
+inline void BayerSuperpixel(const uint8_t* src, int width, int height, uint8_t* dst, size_t dstStride)
+{
+	const int dstWidth = width / 2;
+	const int dstHeight = height / 2;
+
+	for (int y = 0; y < dstHeight; y++)
+	{
+		const uint8_t* row0 = src + (size_t)(2 * y) * width;     // R G R G ...
+		const uint8_t* row1 = src + (size_t)(2 * y + 1) * width; // G B G B ...
+		uint8_t* dstRow = dst + y * dstStride;
+		int x = 0;
+
+#ifdef SYNCFLIR_SSE2
+		const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+		alignas(16) uint8_t red[16], green[16], blue[16];
+		for (; x + 16 <= dstWidth; x += 16)
+		{
+			__m128i top0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x));
+			__m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x + 16));
+			__m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x));
+			__m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x + 16));
+
+			__m128i r = _mm_packus_epi16(_mm_and_si128(top0, lowBytes), _mm_and_si128(top1, lowBytes));
+			__m128i g0 = _mm_packus_epi16(_mm_srli_epi16(top0, 8), _mm_srli_epi16(top1, 8));
+			__m128i g1 = _mm_packus_epi16(_mm_and_si128(bottom0, lowBytes), _mm_and_si128(bottom1, lowBytes));
+			__m128i b = _mm_packus_epi16(_mm_srli_epi16(bottom0, 8), _mm_srli_epi16(bottom1, 8));
+
+			_mm_store_si128(reinterpret_cast<__m128i*>(red), r);
+			_mm_store_si128(reinterpret_cast<__m128i*>(green), _mm_avg_epu8(g0, g1));
+			_mm_store_si128(reinterpret_cast<__m128i*>(blue), b);
+
+			uint8_t* out = dstRow + 3 * x;
+			for (int k = 0; k < 16; k++)
+			{
+				out[3 * k] = blue[k];
+				out[3 * k + 1] = green[k];
+				out[3 * k + 2] = red[k];
+			}
+		}
+#endif
+		for (; x < dstWidth; x++)
+		{
+			uint8_t* out = dstRow + 3 * x;
+			out[0] = row1[2 * x + 1];
+			out[1] = (uint8_t)((row0[2 * x + 1] + row1[2 * x] + 1) / 2);
+			out[2] = row0[2 * x];
+		}
+	}
+}
+
+/*
+=================
+The function ProxyDownscale reduces a raw frame by an integer factor before any full resolution demosaicing. BayerRG8 frames are turned into BGR8 with BayerSuperpixel and, for factors above 2, averaged further with BoxDownscale. Mono8 frames use BoxDownscale directly. scratch holds the half resolution BGR8 frame between both steps.
+=================
+*/
+inline void ProxyDownscale(const uint8_t* src, int width, int height, bool bayer, int factor, uint8_t* dst, size_t dstStride, std::vector<uint8_t>& scratch)
+{
+	if (!bayer)
+	{
+		BoxDownscale(src, width, height, 1, factor, dst, dstStride);
+		return;
+	}
+
+	if (factor == 2)
+	{
+		BayerSuperpixel(src, width, height, dst, dstStride);
+		return;
+	}
+
+	const int halfWidth = width / 2;
+	const int halfHeight = height / 2;
+	scratch.resize((size_t)halfWidth * halfHeight * 3);
+	BayerSuperpixel(src, width, height, scratch.data(), (size_t)halfWidth * 3);
+	BoxDownscale(scratch.data(), halfWidth, halfHeight, 3, factor / 2, dst, dstStride);
+}
+
+/*
+=================
+The function MeanAbsDifference returns the mean absolute difference of two 8 bit buffers, used as motion energy of two downscaled frames. With SSE2 the differences of 16 values are summed per step with _mm_sad_epu8.
+=================
+*/
+inline double MeanAbsDifference(const uint8_t* a, const uint8_t* b, size_t count)
+{
+	uint64_t sum = 0;
+	size_t i = 0;
+#ifdef SYNCFLIR_SSE2
+	__m128i total = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i blockA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i blockB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		total = _mm_add_epi64(total, _mm_sad_epu8(blockA, blockB));
+	}
+	alignas(16) uint64_t halves[2];
+	_mm_store_si128(reinterpret_cast<__m128i*>(halves), total);
+	sum = halves[0] + halves[1];
+#endif
+	for (; i < count; i++)
+	{
+		sum += (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+	}
+	return count > 0 ? (double)sum / count : 0.0;
+}
@@ -0,0 +1,317 @@
+/*
+====================================================================================================
+This header contains the output backends of RECtoBIN. A FrameSink receives the raw images of one
+camera in the .tmp container format, i.e. images written back to back into one file per camera,
+trial and segment. FileSink writes to the local disk, TcpSink streams the same files to a storage
+node running TCPtoBIN, which writes them to its own disk. Each TcpSink uses its own connection, so
+cameras do not share a socket. Every message starts with a SinkMessage record followed by size bytes:
+the filename for SINK_OPEN, the image for SINK_FRAME and nothing for SINK_CLOSE.
+On Windows include this header before windows.h, winsock2.h has to come first.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <fstream>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET SinkSocket;
+#else
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+typedef int SinkSocket;
+#define INVALID_SOCKET (-1)
+#endif
+
+const uint32_t SINK_MAGIC = 0x544C4653; // "SFLT"
+const uint64_t SINK_MAX_NAME = 4096; // longest filename of SINK_OPEN
+const uint64_t SINK_MAX_FRAME = 64ull * 1024 * 1024; // largest image of SINK_FRAME, a receiver closes connections that announce more
+
+enum sinkMessageType
+{
+	SINK_OPEN = 1,
+	SINK_FRAME = 2,
+	SINK_CLOSE = 3
+};
+
+struct SinkMessage
+{
+	uint32_t magic;
+	uint32_t type;
+	uint32_t camera;
+	uint32_t reserved;
+	uint64_t frameID;
+	uint64_t timestamp; // camera timestamp in nanoseconds
+	uint64_t size; // bytes following the message
+};
+
+static_assert(sizeof(SinkMessage) == 40, "SinkMessage is sent as is");
+
+/*
+=================
+The functions StartSockets and CloseSocket hide the socket differences between Windows and other systems. SendParts sends several buffers with one gather call per attempt (WSASend or sendmsg), so an image goes out of the camera buffer without being copied behind its message. ReceiveAll reads exactly size bytes.
+=================
+*/
+inline bool StartSockets()
+{
+#if defined(_WIN32)
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+	return true;
+#endif
+}
+
+inline void CloseSocket(SinkSocket socketHandle)
+{
+#if defined(_WIN32)
+	closesocket(socketHandle);
+#else
+	close(socketHandle);
+#endif
+}
+
+struct SinkPart
+{
+	const char* data;
+	size_t size;
+};
+
+inline bool SendParts(SinkSocket socketHandle, SinkPart* parts, int count)
+{
+	int first = 0;
+	while (first < count)
+	{
+#if defined(_WIN32)
+		WSABUF buffers[4];
+		int used = 0;
+		for (int i = first; i < count && used < 4; i++, used++)
+		{
+			buffers[used].buf = const_cast<char*>(parts[i].data);
+			buffers[used].len = (ULONG)parts[i].size;
+		}
+		DWORD sentBytes = 0;
+		if (WSASend(socketHandle, buffers, used, &sentBytes, 0, NULL, NULL) != 0)
+		{
+			return false;
+		}
+		size_t sent = sentBytes;
+#else
+		struct iovec buffers[4];
+		int used = 0;
+		for (int i = first; i < count && used < 4; i++, used++)
+		{
+			buffers[used].iov_base = const_cast<char*>(parts[i].data);
+			buffers[used].iov_len = parts[i].size;
+		}
+		struct msghdr message = {};
+		message.msg_iov = buffers;
+		message.msg_iovlen = used;
+		ssize_t sentBytes = sendmsg(socketHandle, &message, MSG_NOSIGNAL);
+		if (sentBytes < 0)
+		{
+			return false;
+		}
+		size_t sent = (size_t)sentBytes;
+#endif
+		// Skip what was sent, a partial send continues inside a part
+		while (first < count && sent >= parts[first].size)
+		{
+			sent -= parts[first].size;
+			first++;
+		}
+		if (first < count)
+		{
+			parts[first].data += sent;
+			parts[first].size -= sent;
+		}
+	}
+	return true;
+}
+
+inline bool ReceiveAll(SinkSocket socketHandle, char* data, size_t size)
+{
+	while (size > 0)
+	{
+		int chunk = (int)(size < (1 << 30) ? size : (1 << 30));
+		int received = recv(socketHandle, data, chunk, 0);
+		if (received <= 0)
+		{
+			return false;
+		}
+		data += received;
+		size -= received;
+	}
+	return true;
+}
+
+/*
+=================
+The class FrameSink is the interface for all output backends of one camera. Open starts a new .tmp file, Write appends one image and Close finishes the file. Functions return 0 on success and -1 on errors.
+=================
+*/
+class FrameSink
+{
+public:
+	virtual ~FrameSink() {}
+	virtual int Open(const std::string& filename) = 0;
+	virtual int Write(const char* imageData, size_t size, uint64_t frameID, uint64_t timestamp) = 0;
+	virtual int Close() = 0;
+};
+
+/*
+=================
+The class FileSink writes the .tmp files to the local disk, as RECtoBIN always did.
+=================
+*/
+class FileSink : public FrameSink
+{
+public:
+	int Open(const std::string& filename)
+	{
+		file.clear();
+		file.open(filename.c_str(), std::ios_base::out | std::ios_base::binary);
+		return file.good() ? 0 : -1;
+	}
+
+	int Write(const char* imageData, size_t size, uint64_t /*frameID*/, uint64_t /*timestamp*/)
+	{
+		file.write(imageData, size);
+		return file.good() ? 0 : -1;
+	}
+
+	int Close()
+	{
+		if (file.is_open())
+		{
+			file.close();
+		}
+		return 0;
+	}
+
+private:
+	std::ofstream file;
+};
+
+/*
+=================
+The class TcpSink streams the .tmp files of one camera to TCPtoBIN. The connection is opened with the first file and kept for all trials and segments. Only the filename without directory is sent, the receiver saves it in its own directory.
+=================
+*/
+class TcpSink : public FrameSink
+{
+public:
+	TcpSink(std::string host, int port, uint32_t camera) : host(host), port(port), camera(camera), socketHandle(INVALID_SOCKET) {}
+
+	~TcpSink()
+	{
+		if (socketHandle != INVALID_SOCKET)
+		{
+			CloseSocket(socketHandle);
+		}
+	}
+
+	int Open(const std::string& filename)
+	{
+		if (socketHandle == INVALID_SOCKET && Connect() != 0)
+		{
+			return -1;
+		}
+
+		std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+		SinkMessage message = Message(SINK_OPEN, 0, 0, name.size());
+		SinkPart parts[2] = { { reinterpret_cast<const char*>(&message), sizeof(message) }, { name.c_str(), name.size() } };
+		return SendParts(socketHandle, parts, 2) ? 0 : -1;
+	}
+
+	int Write(const char* imageData, size_t size, uint64_t frameID, uint64_t timestamp)
+	{
+		if (size > SINK_MAX_FRAME)
+		{
+			return -1;
+		}
+		SinkMessage message = Message(SINK_FRAME, frameID, timestamp, size);
+		SinkPart parts[2] = { { reinterpret_cast<const char*>(&message), sizeof(message) }, { imageData, size } };
+		return SendParts(socketHandle, parts, 2) ? 0 : -1;
+	}
+
+	int Close()
+	{
+		if (socketHandle == INVALID_SOCKET)
+		{
+			return 0;
+		}
+		SinkMessage message = Message(SINK_CLOSE, 0, 0, 0);
+		SinkPart parts[1] = { { reinterpret_cast<const char*>(&message), sizeof(message) } };
+		return SendParts(socketHandle, parts, 1) ? 0 : -1;
+	}
+
+private:
+	int Connect()
+	{
+		struct addrinfo hints = {};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo* addresses = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+		{
+			return -1;
+		}
+
+		for (struct addrinfo* address = addresses; address != nullptr; address = address->ai_next)
+		{
+			socketHandle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (socketHandle == INVALID_SOCKET)
+			{
+				continue;
+			}
+			if (connect(socketHandle, address->ai_addr, (int)address->ai_addrlen) == 0)
+			{
+				break;
+			}
+			CloseSocket(socketHandle);
+			socketHandle = INVALID_SOCKET;
+		}
+		freeaddrinfo(addresses);
+		if (socketHandle == INVALID_SOCKET)
+		{
+			return -1;
+		}
+
+		// Large send buffer, so the grab thread rarely waits for the network
+		int sendBuffer = 64 * 1024 * 1024;
+		setsockopt(socketHandle, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&sendBuffer), sizeof(sendBuffer));
+		return 0;
+	}
+
+	SinkMessage Message(uint32_t type, uint64_t frameID, uint64_t timestamp, uint64_t size)
+	{
+		SinkMessage message = {};
+		message.magic = SINK_MAGIC;
+		message.type = type;
+		message.camera = camera;
+		message.frameID = frameID;
+		message.timestamp = timestamp;
+		message.size = size;
+		return message;
+	}
+
+	std::string host;
+	int port;
+	uint32_t camera;
+	SinkSocket socketHandle;
+};
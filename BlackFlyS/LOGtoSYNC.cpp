@@ -0,0 +1,179 @@
+/*
+====================================================================================================
+This program builds the session sync table of a recording. It reads the csv logfile written by
+RECtoBIN, or the session index of a coordinated recording, in one streaming pass per trial and saves
+which frame of every camera belongs to each trigger pulse of the primary camera as
+<logfile>_trial<k>_sync.bin, together with clock drift, jitter and skew statistics per camera. A
+recording with a single trial is saved as <logfile>_sync.bin. Set SyncTable in the metadata file
+to convert videos with it in BINtoAVI. Start it with:
+LOGtoSYNC <metadata> <logfile> [trial] [serial1+serial2+...]
+Without a trial one table is saved for every trial of the logfile, each trial has its own binary
+files. Without serial numbers all cameras in the logfile are aligned, the first one is the skew
+reference.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#include "SyncTable.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+using namespace std::chrono;
+using namespace std;
+
+/*
+=================
+The function ReadFrameRate takes the Framerate of the recording from the metadata file written by RECtoBIN.
+=================
+*/
+double ReadFrameRate(string metadata)
+{
+	ifstream metadataFile(metadata);
+	string line;
+	while (getline(metadataFile, line))
+	{
+		line.erase(remove_if(line.begin(), line.end(), ::isspace), line.end());
+		if (line.rfind("Framerate=", 0) == 0)
+		{
+			return stod(line.substr(10));
+		}
+	}
+	return 0;
+}
+
+/*
+=================
+The function SaveSyncTable aligns all records of the chosen cameras in one trial and writes one table row per session frame to syncFilename. It returns 0 on success and -1 on errors.
+=================
+*/
+int SaveSyncTable(const string& logFilename, const string& trial, vector<string> serials, double frameRate, const string& syncFilename)
+{
+	cout << endl << "*** TRIAL " << trial << " ***" << endl << endl;
+
+	// Serial numbers from the command line, otherwise all cameras of the trial
+	if (serials.empty())
+	{
+		cout << "Reading camera serial numbers from " << logFilename << "..." << endl;
+		serials = ListSyncCameras(logFilename, trial);
+	}
+	if (serials.empty())
+	{
+		cout << "No cameras found in " << logFilename << " for trial " << trial << ". Aborting..." << endl;
+		return -1;
+	}
+
+	ofstream syncFile(syncFilename, ios_base::out | ios_base::binary);
+
+	SyncTable table;
+	table.Init(serials, frameRate);
+	table.trial = SyncTrialNumber(trial);
+	if (!WriteSyncTableHeader(syncFile, table, 0))
+	{
+		cout << "Unable to create " << syncFilename << ". Aborting..." << endl;
+		return -1;
+	}
+
+	table.emit = [&](int64_t /*sessionFrame*/, const int32_t* offsets, const uint64_t* frameIDs)
+	{
+		WriteSyncTableRow(syncFile, serials.size(), offsets, frameIDs);
+	};
+
+	cout << "Aligning " << serials.size() << " cameras at " << frameRate << " FPS..." << endl;
+	auto alignStart = steady_clock::now();
+	int64_t records = ReadSyncLog(logFilename, trial, table);
+	if (records < 0)
+	{
+		cout << "Error opening logfile: " << logFilename << " Aborting..." << endl;
+		return -1;
+	}
+	double alignSeconds = duration<double>(steady_clock::now() - alignStart).count();
+
+	WriteSyncTableHeader(syncFile, table, (uint64_t)table.framesEmitted);
+	syncFile.close();
+	if (!syncFile.good())
+	{
+		cout << "Error writing to file " << syncFilename << " !" << endl;
+		return -1;
+	}
+
+	cout << records << " records aligned in " << alignSeconds << " s" << endl << endl;
+	ReportSyncTable(table, cout);
+	cout << endl << "Sync table " << syncFilename << " saved" << endl;
+	return 0;
+}
+
+/*
+=================
+This is the Entry point for the program. It saves the sync table of the chosen trial, or of every trial in the logfile.
+=================
+*/
+int main(int argc, char** argv)
+{
+	cout << "*************************************************************" << endl;
+	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
+	cout << "MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com" << endl;
+	cout << "*************************************************************" << endl;
+
+	if (argc < 3)
+	{
+		cout << "Usage: LOGtoSYNC <metadata> <logfile> [trial] [serial1+serial2+...]" << endl;
+		return -1;
+	}
+	string logFilename = argv[2];
+	string trial = (argc > 3) ? argv[3] : "";
+
+	double frameRate = ReadFrameRate(argv[1]);
+	if (frameRate <= 0)
+	{
+		cout << "No Framerate found in metadata file " << argv[1] << ". Aborting..." << endl;
+		return -1;
+	}
+
+	// Serial numbers from the command line, otherwise all cameras of each trial
+	vector<string> serials;
+	if (argc > 4)
+	{
+		stringstream serialList(argv[4]);
+		string serial;
+		while (getline(serialList, serial, '+'))
+		{
+			serials.push_back(serial);
+		}
+	}
+
+	// Trial from the command line, otherwise every trial of the logfile
+	vector<string> trials;
+	if (!trial.empty())
+	{
+		trials.push_back(trial);
+	}
+	else
+	{
+		trials = ListSyncTrials(logFilename);
+	}
+	if (trials.empty())
+	{
+		cout << "No records found in " << logFilename << ". Aborting..." << endl;
+		return -1;
+	}
+
+	string baseFilename = logFilename.substr(0, logFilename.rfind('.'));
+	int result = 0;
+	for (const string& syncTrial : trials)
+	{
+		bool singleTrial = trial.empty() && trials.size() == 1;
+		string syncFilename = baseFilename + (singleTrial ? "" : "_trial" + syncTrial) + "_sync.bin";
+		if (SaveSyncTable(logFilename, syncTrial, serials, frameRate, syncFilename) != 0)
+		{
+			result = -1;
+		}
+	}
+	return result;
+}
@@ -14,8 +14,13 @@ Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
 ====================================================================================================
 */
 
+#include "FrameSink.h" // before Spinnaker.h, winsock2.h has to come before windows.h
 #include "Spinnaker.h"
 #include "SpinGenApi/SpinnakerGenApi.h"
+#include "Downscale.h"
+#include "SharedFrames.h"
+#include "BandwidthPlan.h"
+#include "CommitWindows.h"
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -28,9 +33,25 @@ Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
 #include <chrono>
 #include <algorithm>
 #include <string>
-#ifndef _WIN32
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#if defined(_WIN32)
+#include <conio.h>
+#else
 #include <pthread.h>
-
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/resource.h>
 #endif
 
 using namespace std::chrono;
@@ -49,18 +70,97 @@ int widthToSet;
 int heightToSet;
 double NewFrameRate;
 // TODO: use decimation or binning instead of size compression (http://softwareservices.flir.com/BFS-U3-89S6/latest/Model/public/ImageFormatControl.html)
-int numBuffers = 200; // depending on RAM
+int numBuffers = 200; // stream buffers per camera if bufferSeconds is 0
+double bufferSeconds = 2.0; // seconds of frames each camera can queue in its stream buffers, 0 = numBuffers for every camera
+double bufferRamBudgetMB = 0; // RAM for the stream buffers, frame rings and shared memory of all cameras, 0 = half of the free RAM
+int sessionMode = 0; // 1 = keep cameras armed and record trials on start/stop/next/quit commands
+int purgeTimeout = 20; // milliseconds without a frame after which the stream buffer counts as empty
+int segmentFrames = 0; // frames per .tmp segment, 0 = one file per camera
+int stripeSegments = 0; // 1 = write the segments of each camera round-robin to all volumes in path
+int convertSegments = 0; // 1 = convert finished segments with BINtoAVI while recording
+int converterJobs = 1; // maximum number of concurrent background conversions
+double converterMinIdle = 30.0; // minimum idle CPU in percent before another conversion is started
+std::string converterPath = "BINtoAVI.exe";
+double preTriggerSeconds = 0.0; // > 0 keeps frames in a RAM ring and only saves them around trigger events
+double postTriggerSeconds = 2.0; // seconds saved after each trigger event
+std::string gateCamera; // serial number or "primary", its motion triggers the pre-trigger ring, empty = off
+double gateOn = 4.0; // motion energy (mean gray value difference) that opens the gate
+double gateOff = 2.0; // motion energy below which the gate closes again
+int gateScale = 8; // downscale factor before the frame difference
+int previewEvery = 0; // publish every Nth frame of each camera to shared memory for live viewers, 0 = off
+int previewScale = 4; // downscale factor of preview frames, even for color cameras
+std::string previewName = "syncFLIR_preview"; // name of the preview shared memory
+int fanoutSlots = 0; // full frames kept per camera in shared memory for local consumers, 0 = off
+int fanoutConsumers = 4; // maximum number of attached consumer processes
+std::string fanoutName = "syncFLIR_frames"; // name of the full-rate shared memory
+std::string sinkHost; // storage node running TCPtoBIN, empty = write .tmp files to path
+int sinkPort = 5005;
+std::string role = "standalone"; // primary or secondary machine of a multi-machine setup
+std::string coordinatorHost = "127.0.0.1"; // address of the primary machine, used by secondaries
+int coordinatorPort = 5006;
+int secondaryMachines = 1; // secondary machines the primary waits for before triggering
+double controllerBandwidth = 380; // usable MB/s of one USB3 host controller, 0 = bandwidth planner off
+double bandwidthHeadroom = 10; // percent above the required bandwidth each camera should get
+int bandwidthStrict = 0; // 1 = refuse to record if the bandwidth plan is infeasible, 0 = warn only
+double preflightSeconds = 3; // duration of the storage benchmark before recording, 0 = off
+double preflightMargin = 1.5; // minimum ratio of measured to required write rate
+std::string grabCores; // cores of the grab threads, e.g. 2-5 or node0, one core per camera in turn, empty = any core
+std::string writerCores; // cores shared by ring writers and background conversion, empty = any core
+int realtimePriority = 0; // 1 = grab threads at time critical priority (Windows) or SCHED_FIFO (Linux), their frames are saved by the ring writers
+int chunkData = 1; // 1 = cameras append FrameID, Timestamp, ExposureTime, Gain and line status to every image, logged per frame
+std::string acquisitionMode = "poll"; // poll = grab threads wait in GetNextImage, event = image events fill a frame queue per camera
+int latencyBenchmark = 0; // 1 = sample the delivery latency of the frames and report it after recording
+#if defined(_WIN32)
+std::string controlChannel = "\\\\.\\pipe\\syncFLIR"; // named pipe for start/stop/status/marker commands, empty = off
+#else
+std::string controlChannel = "/tmp/syncFLIR.sock"; // unix domain socket for start/stop/status/marker commands, empty = off
+#endif
 
 // placeholder for names of file and camera IDs
-vector<ofstream> cameraFiles;
+vector<unique_ptr<FrameSink>> cameraSinks; // output of each camera, local .tmp files or TCPtoBIN
+vector<string> cameraFilenames; // current .tmp file of each camera
+vector<string> cameraBaseFilenames; // filename without directory, segment number and extension
+vector<string> volumes; // recording directories listed in path, separated by ;
+vector<int> cameraVolumes; // volume of each camera, with stripeSegments the volume of its first segment
+vector<int> cameraSegments; // current segment number of each camera
+vector<int> segmentFrameCnt; // frames written to the current segment
 ofstream csvFile;
 ofstream metadataFile;
 string metadataFilename;
-int cameraCnt;
-string serialNumber;
+string csvFilename;
+ofstream eventsFile; // event markers received on the control channel
+string eventsFilename;
+string sessionDateTime; // date and time prefix shared by all files of one recording
 
 // mutex lock for parallel threads
-HANDLE ghMutex;
+std::mutex ghMutex;
+
+// queue of finished segments for the background converter, locked by ghSegmentMutex
+vector<string> finishedSegments;
+std::mutex ghSegmentMutex;
+std::atomic<bool> recordingDone(false); // set once all grab threads have returned
+std::atomic<bool> writePressure(false); // set by grab threads when writing falls behind the frame period
+
+// thread layout from grabCores and writerCores, filled by PlanThreadLayout
+vector<int> grabCoreList;
+vector<int> writerCoreList;
+
+// recording state, changed by HandleCommand and the ESC key, read by the grab threads without locking
+std::atomic<int> currentTrial(1);
+std::atomic<bool> trialRunning(false);
+std::atomic<bool> stopRecording(false);
+
+// coordination of primary and secondary machines, the log lines of this machine are collected in coordinatorLog under ghMutex
+std::atomic<bool> coordinated(false);
+string coordinatorLog;
+string coordinatorPrefix; // "primary," in the session index, "L," for log lines sent by a secondary
+int64_t clockOffsetNs = 0; // add to the local system time to get the system time of the primary machine
+
+// commit windows of the pre-trigger ring in FrameIDs, i.e. trigger pulses, so every camera commits the same frames. Opened by OpenCommitWindow and read by the ring writers
+CommitWindows commitWindows;
+
+// commands from the console and the control channel run one at a time
+std::mutex ghCommandMutex;
 
 // Camera trigger type for primary and secondary cameras
 enum triggerType
@@ -69,8 +169,6 @@ enum triggerType
 	HARDWARE // Secondary camera
 };
 
-triggerType chosenTrigger = SOFTWARE; // standard initialization
-
 
 /*
 ================
@@ -81,14 +179,14 @@ int readconfig()
 {
 	int result = 0;
 
-	std::ifstream cFile("myConfig.txt");
+	std::ifstream cFile("myconfig.txt");
 	if (cFile.is_open())
 	{
 
 		std::string line;
 		while (getline(cFile, line))
 		{
-			line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
+			line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
 			if (line[0] == '#' || line.empty()) continue;
 
 			auto delimiterPos = line.find("=");
@@ -101,7 +199,58 @@ int readconfig()
 			else if (name == "compression") compression = std::stod(value);
 			else if (name == "exposureTime") exposureTime = std::stod(value);
 			else if (name == "numBuffers") numBuffers = std::stod(value);
-			else if (name == "path") path = value;
+			else if (name == "bufferSeconds") bufferSeconds = std::stod(value);
+			else if (name == "bufferRamBudgetMB") bufferRamBudgetMB = std::stod(value);
+			else if (name == "path")
+			{
+				// Several recording volumes are separated by ;, session files go to the first one
+				volumes.clear();
+				stringstream volumeList(value);
+				string volume;
+				while (getline(volumeList, volume, ';'))
+				{
+					volumes.push_back(volume);
+				}
+				path = volumes.empty() ? "" : volumes[0];
+			}
+			else if (name == "stripeSegments") stripeSegments = std::stoi(value);
+			else if (name == "sessionMode") sessionMode = std::stoi(value);
+			else if (name == "purgeTimeout") purgeTimeout = std::stoi(value);
+			else if (name == "segmentFrames") segmentFrames = std::stoi(value);
+			else if (name == "convertSegments") convertSegments = std::stoi(value);
+			else if (name == "converterJobs") converterJobs = std::stoi(value);
+			else if (name == "converterMinIdle") converterMinIdle = std::stod(value);
+			else if (name == "converterPath") converterPath = value;
+			else if (name == "controlChannel" && value != "default") controlChannel = value;
+			else if (name == "preTriggerSeconds") preTriggerSeconds = std::stod(value);
+			else if (name == "postTriggerSeconds") postTriggerSeconds = std::stod(value);
+			else if (name == "gateCamera") gateCamera = value;
+			else if (name == "gateOn") gateOn = std::stod(value);
+			else if (name == "gateOff") gateOff = std::stod(value);
+			else if (name == "gateScale") gateScale = std::stoi(value);
+			else if (name == "previewEvery") previewEvery = std::stoi(value);
+			else if (name == "previewScale") previewScale = std::stoi(value);
+			else if (name == "previewName") previewName = value;
+			else if (name == "fanoutSlots") fanoutSlots = std::stoi(value);
+			else if (name == "fanoutConsumers") fanoutConsumers = std::stoi(value);
+			else if (name == "fanoutName") fanoutName = value;
+			else if (name == "sinkHost") sinkHost = value;
+			else if (name == "sinkPort") sinkPort = std::stoi(value);
+			else if (name == "role") role = value;
+			else if (name == "coordinatorHost") coordinatorHost = value;
+			else if (name == "coordinatorPort") coordinatorPort = std::stoi(value);
+			else if (name == "secondaryMachines") secondaryMachines = std::stoi(value);
+			else if (name == "controllerBandwidth") controllerBandwidth = std::stod(value);
+			else if (name == "bandwidthHeadroom") bandwidthHeadroom = std::stod(value);
+			else if (name == "bandwidthStrict") bandwidthStrict = std::stoi(value);
+			else if (name == "preflightSeconds") preflightSeconds = std::stod(value);
+			else if (name == "preflightMargin") preflightMargin = std::stod(value);
+			else if (name == "grabCores") grabCores = value;
+			else if (name == "writerCores") writerCores = value;
+			else if (name == "realtimePriority") realtimePriority = std::stoi(value);
+			else if (name == "acquisitionMode") acquisitionMode = value;
+			else if (name == "latencyBenchmark") latencyBenchmark = std::stoi(value);
+			else if (name == "chunkData") chunkData = std::stoi(value);
 		}
 	}
 	else
@@ -114,8 +263,90 @@ int readconfig()
 	std::cout << "\nFPS=" << FPS;
 	std::cout << "\ncompression=" << compression;
 	std::cout << "\nexposureTime=" << exposureTime;
-	std::cout << "\nnumBuffers=" << numBuffers;
-	std::cout << "\nPath=" << path << endl << endl;
+	std::cout << "\nbufferSeconds=" << bufferSeconds;
+	if (bufferSeconds <= 0)
+	{
+		std::cout << "\nnumBuffers=" << numBuffers;
+	}
+	std::cout << "\nbufferRamBudgetMB=" << bufferRamBudgetMB;
+	std::cout << "\nsessionMode=" << sessionMode;
+	std::cout << "\npurgeTimeout=" << purgeTimeout;
+	std::cout << "\nsegmentFrames=" << segmentFrames;
+	std::cout << "\nconvertSegments=" << convertSegments;
+	if (convertSegments == 1)
+	{
+		std::cout << "\nconverterJobs=" << converterJobs;
+		std::cout << "\nconverterMinIdle=" << converterMinIdle;
+		std::cout << "\nconverterPath=" << converterPath;
+	}
+	std::cout << "\ncontrolChannel=" << controlChannel;
+	std::cout << "\npreviewEvery=" << previewEvery;
+	if (previewEvery > 0)
+	{
+		std::cout << "\npreviewScale=" << previewScale;
+		std::cout << "\npreviewName=" << previewName;
+	}
+	std::cout << "\nfanoutSlots=" << fanoutSlots;
+	if (fanoutSlots > 0)
+	{
+		std::cout << "\nfanoutConsumers=" << fanoutConsumers;
+		std::cout << "\nfanoutName=" << fanoutName;
+	}
+	std::cout << "\npreTriggerSeconds=" << preTriggerSeconds;
+	if (preTriggerSeconds > 0)
+	{
+		std::cout << "\npostTriggerSeconds=" << postTriggerSeconds;
+		std::cout << "\ngateCamera=" << gateCamera;
+		if (!gateCamera.empty())
+		{
+			std::cout << "\ngateOn=" << gateOn;
+			std::cout << "\ngateOff=" << gateOff;
+			std::cout << "\ngateScale=" << gateScale;
+		}
+	}
+	if (!sinkHost.empty())
+	{
+		std::cout << "\nsinkHost=" << sinkHost;
+		std::cout << "\nsinkPort=" << sinkPort;
+	}
+	std::cout << "\ncontrollerBandwidth=" << controllerBandwidth;
+	if (controllerBandwidth > 0)
+	{
+		std::cout << "\nbandwidthHeadroom=" << bandwidthHeadroom;
+		std::cout << "\nbandwidthStrict=" << bandwidthStrict;
+	}
+	std::cout << "\npreflightSeconds=" << preflightSeconds;
+	if (preflightSeconds > 0)
+	{
+		std::cout << "\npreflightMargin=" << preflightMargin;
+	}
+	std::cout << "\ngrabCores=" << grabCores;
+	std::cout << "\nwriterCores=" << writerCores;
+	std::cout << "\nrealtimePriority=" << realtimePriority;
+	std::cout << "\nacquisitionMode=" << acquisitionMode;
+	std::cout << "\nlatencyBenchmark=" << latencyBenchmark;
+	std::cout << "\nchunkData=" << chunkData;
+	std::cout << "\nrole=" << role;
+	if (role == "primary")
+	{
+		std::cout << "\ncoordinatorPort=" << coordinatorPort;
+		std::cout << "\nsecondaryMachines=" << secondaryMachines;
+	}
+	else if (role == "secondary")
+	{
+		std::cout << "\ncoordinatorHost=" << coordinatorHost;
+		std::cout << "\ncoordinatorPort=" << coordinatorPort;
+	}
+	std::cout << "\nPath=" << path;
+	for (size_t v = 1; v < volumes.size(); v++)
+	{
+		std::cout << ";" << volumes[v];
+	}
+	if (volumes.size() > 1 && segmentFrames > 0)
+	{
+		std::cout << "\nstripeSegments=" << stripeSegments;
+	}
+	std::cout << endl << endl;
 
 	return result, triggerCam, exposureTime, path, FPS, compression, numBuffers;
 }
@@ -197,222 +428,769 @@ auto getTimeStamp()
 
 /*
 =================
-The function CreateFiles works within a for loop and creates .tmp binary files for each camera, as well as a single .csv logging sheet csvFile. The files are saved in working irectory.
+The function EscapePressed checks the console for the ESC key without waiting, only keys typed into the console window count. On Linux the terminal delivers keys without Enter only after CaptureKeyboard(true), CaptureKeyboard(false) restores the line input the session mode console reads from.
 =================
 */
-int CreateFiles(string serialNumber, int cameraCnt)
+#if !defined(_WIN32)
+struct termios lineTerminal;
+bool keyboardCaptured = false;
+#endif
+
+void CaptureKeyboard(bool capture)
 {
-	int result = 0;
-	cout << endl << "*** CREATING FILES ***" << endl << endl;
+#if !defined(_WIN32)
+	if (capture && !keyboardCaptured && isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &lineTerminal) == 0)
+	{
+		struct termios keyTerminal = lineTerminal;
+		keyTerminal.c_lflag &= ~(ICANON | ECHO);
+		keyTerminal.c_cc[VMIN] = 0;
+		keyTerminal.c_cc[VTIME] = 0;
+		keyboardCaptured = tcsetattr(STDIN_FILENO, TCSANOW, &keyTerminal) == 0;
+	}
+	else if (!capture && keyboardCaptured)
+	{
+		tcsetattr(STDIN_FILENO, TCSANOW, &lineTerminal);
+		keyboardCaptured = false;
+	}
+#else
+	(void)capture;
+#endif
+}
+
+bool EscapePressed()
+{
+#if defined(_WIN32)
+	while (_kbhit())
+	{
+		if (_getch() == 27)
+		{
+			return true;
+		}
+	}
+#else
+	struct pollfd console = { STDIN_FILENO, POLLIN, 0 };
+	while (keyboardCaptured && poll(&console, 1, 0) > 0)
+	{
+		char key;
+		if (read(STDIN_FILENO, &key, 1) != 1)
+		{
+			break;
+		}
+		if (key == 27)
+		{
+			return true;
+		}
+	}
+#endif
+	return false;
+}
+
+/*
+=================
+The function ReadConsoleLine waits up to timeoutMs for a line typed into the console, so that the session mode console can be stopped after recording instead of blocking in getline. It returns 1 with the line, 0 on timeout and -1 once the console is closed. On Windows the line is assembled from single keys and echoed, on Linux the terminal stays in line mode.
+=================
+*/
+int ReadConsoleLine(string& line, int timeoutMs)
+{
+	static string pending;
+#if defined(_WIN32)
+	auto deadline = steady_clock::now() + milliseconds(timeoutMs);
+	do
+	{
+		while (_kbhit())
+		{
+			int key = _getch();
+			if (key == '\r')
+			{
+				cout << endl;
+				line = pending;
+				pending.clear();
+				return 1;
+			}
+			else if (key == '\b')
+			{
+				if (!pending.empty())
+				{
+					pending.pop_back();
+					cout << "\b \b" << flush;
+				}
+			}
+			else if (key >= 32 && key < 127)
+			{
+				pending += (char)key;
+				cout << (char)key << flush;
+			}
+		}
+		this_thread::sleep_for(milliseconds(10));
+	} while (steady_clock::now() < deadline);
+#else
+	struct pollfd console = { STDIN_FILENO, POLLIN, 0 };
+	if (pending.find('\n') == string::npos && poll(&console, 1, timeoutMs) > 0)
+	{
+		char buffer[256];
+		ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+		if (count <= 0)
+		{
+			// the last line may end without a line break
+			if (pending.empty())
+			{
+				return -1;
+			}
+			pending += '\n';
+		}
+		else
+		{
+			pending.append(buffer, count);
+		}
+	}
+	size_t end = pending.find('\n');
+	if (end != string::npos)
+	{
+		line = pending.substr(0, end);
+		pending.erase(0, end + 1);
+		return 1;
+	}
+#endif
+	return 0;
+}
 
-	stringstream sstream_tmpFilename;
+/*
+=================
+The function CreateSessionFiles creates the single .csv logging sheet csvFile and the metadata filename once for all cameras. The function CreateFiles creates the .tmp binary file for one camera on the volume assigned by PlanVolumes. The session files are saved in the first volume of path.
+=================
+*/
+int CreateSessionFiles(unsigned int numCameras)
+{
+	int result = 0;
 	stringstream sstream_csvFile;
 	stringstream sstream_metadataFile;
-	string tmpFilename;
-	string csvFilename;
-	ofstream filename; // TODO: still needed?
 	const string csDestinationDirectory = path;
 
-	// Create temporary file from serialnum assigned to cameraCnt
-	sstream_tmpFilename << csDestinationDirectory << getCurrentDateTime() + "_" + serialNumber << "_file" << cameraCnt << ".tmp";
-	sstream_tmpFilename >> tmpFilename;
+	// One timestamp for all files of this recording
+	// A secondary machine uses the name sent by the primary machine
+	if (sessionDateTime.empty())
+	{
+		sessionDateTime = getCurrentDateTime();
+	}
 
-	cout << "File " << tmpFilename << " initialized" << endl;
+	// Per camera entries are filled by CreateFiles
+	cameraSinks.resize(numCameras);
+	cameraFilenames.resize(numCameras);
+	cameraVolumes.assign(numCameras, 0);
+	cameraBaseFilenames.resize(numCameras);
+	cameraSegments.assign(numCameras, 0);
+	segmentFrameCnt.assign(numCameras, 0);
 
-	cameraFiles.push_back(std::move(filename)); // TODO: still needed?
-	cameraFiles[cameraCnt].open(tmpFilename.c_str(), ios_base::out | ios_base::binary);
+	// create csv logfile with headers
+	sstream_csvFile << csDestinationDirectory << "logfile_" << sessionDateTime << ".csv";
+	sstream_csvFile >> csvFilename;
 
-	// Create .csv logfile and .txt metadata only once for all cameras during first loop
-	if (cameraCnt == 0)
+	cout << "CSV file: " << csvFilename << " initialized" << endl << endl;
+
+	csvFile.open(csvFilename);
+	csvFile << "FrameID" << "," << "Timestamp" << "," << "SerialNumber" << "," << "FileNumber" << "," << "SystemTimeInNanoseconds" << "," << "Trial";
+	if (chunkData == 1)
 	{
-		// create csv logfile with headers
-		sstream_csvFile << csDestinationDirectory << "logfile_" << getCurrentDateTime() << ".csv";
-		sstream_csvFile >> csvFilename;
+		csvFile << "," << "ExposureTime" << "," << "Gain" << "," << "LineStatus";
+	}
+	csvFile << endl;
 
-		cout << "CSV file: " << csvFilename << " initialized" << endl << endl;
+	// create txt metadata
+	sstream_metadataFile << csDestinationDirectory << "metadata_" << sessionDateTime << ".txt";
+	sstream_metadataFile >> metadataFilename;
 
-		csvFile.open(csvFilename);
-		csvFile << "FrameID" << "," << "Timestamp" << "," << "SerialNumber" << "," << "FileNumber" << "," << "SystemTimeInNanoseconds" << endl;
+	// events file is only created once the first marker arrives
+	eventsFilename = csDestinationDirectory + "events_" + sessionDateTime + ".csv";
 
-		// create txt metadata
-		sstream_metadataFile << csDestinationDirectory << "metadata_"<< getCurrentDateTime() << ".txt";
-		sstream_metadataFile >> metadataFilename;
+	return result;
+}
 
+/*
+=================
+The function CreateSink returns the output backend of one camera chosen in the config file, local .tmp files or a connection to TCPtoBIN.
+=================
+*/
+unique_ptr<FrameSink> CreateSink(int cameraCnt)
+{
+	if (sinkHost.empty())
+	{
+		return unique_ptr<FrameSink>(new FileSink());
 	}
-	return result;
+	return unique_ptr<FrameSink>(new TcpSink(sinkHost, sinkPort, cameraCnt));
 }
 
 /*
 =================
-The function ImageSettings configures the image compression i.e., the actual image width and height.
+The function OpenCameraFile opens the current .tmp file of a camera, <base>_seg<k>.tmp on its volume or, with stripeSegments, on the volume k steps after it. Segmented local recordings list every segment in <base>.idx in the first volume, BINtoAVI reads the segments of an index back as one file.
 =================
 */
-int ImageSettings(INodeMap& nodeMap)
+int OpenCameraFile(int fileCnt)
 {
-	int result = 0;
-	cout << endl << "*** CONFIGURING IMAGE SETTINGS ***" << endl << endl;
+	int segment = cameraSegments[fileCnt];
+	size_t volume = cameraVolumes[fileCnt];
+	if (stripeSegments == 1)
+	{
+		volume = (volume + segment) % volumes.size();
+	}
+	cameraFilenames[fileCnt] = volumes[volume] + cameraBaseFilenames[fileCnt] + (segmentFrames > 0 ? "_seg" + to_string(segment) : "") + ".tmp";
 
-	try
+	if (segmentFrames > 0 && sinkHost.empty())
 	{
-		// TODO: update with decimation and or binning
+		ofstream indexFile(path + cameraBaseFilenames[fileCnt] + ".idx", ios_base::app);
+		indexFile << cameraFilenames[fileCnt] << endl;
+	}
+	return cameraSinks[fileCnt]->Open(cameraFilenames[fileCnt]);
+}
 
-		// Set image width
-		CIntegerPtr ptrWidth = nodeMap.GetNode("Width");
-		if (IsAvailable(ptrWidth) && IsWritable(ptrWidth))
-		{
-			int width = ptrWidth->GetMax();
-			widthToSet = width / compression;
-			ptrWidth->SetValue(widthToSet);
+int CreateFiles(string serialNumber, int cameraCnt, ostream& out)
+{
+	int result = 0;
+	out << endl << "*** CREATING FILES ***" << endl << endl;
 
+	// Create temporary file from serialnum assigned to cameraCnt
+	string baseFilename = sessionDateTime + "_" + serialNumber + "_file" + to_string(cameraCnt);
 
-			cout << "Width set to " << ptrWidth->GetValue() << "..." << endl;
-		}
-		else
-		{
-			cout << "Width not available..." << endl;
-		}
+	// In session mode every trial has its own files
+	if (sessionMode == 1)
+	{
+		baseFilename += "_trial1";
+	}
+	cameraBaseFilenames[cameraCnt] = baseFilename;
 
-		// Set maximum height
-		CIntegerPtr ptrHeight = nodeMap.GetNode("Height");
-		if (IsAvailable(ptrHeight) && IsWritable(ptrHeight))
-		{
-			int height = ptrHeight->GetMax();
-			heightToSet = height / compression;
-			ptrHeight->SetValue(heightToSet);
+	// Segmented recordings start with segment 0
+	cameraSegments[cameraCnt] = 0;
+	cameraSinks[cameraCnt] = CreateSink(cameraCnt);
+	if (OpenCameraFile(cameraCnt) != 0)
+	{
+		out << "Unable to create file " << cameraFilenames[cameraCnt] << (sinkHost.empty() ? "" : " on " + sinkHost) << ". Aborting..." << endl;
+		return -1;
+	}
 
-			cout << "Height set to " << ptrHeight->GetValue() << "..." << endl << endl;
-		}
-		else
-		{
-			cout << "Height not available..." << endl << endl;
-		}
+	out << "File " << cameraFilenames[cameraCnt] << " initialized" << endl;
+	return result;
+}
+
+/*
+=================
+The function FinishSegment closes the current .tmp file of a camera and hands it to the background converter. The function RollSegment also opens the next segment, it is called from the grab thread every segmentFrames frames.
+=================
+*/
+void FinishSegment(int fileCnt)
+{
+	cameraSinks[fileCnt]->Close();
+
+	ghSegmentMutex.lock();
+	finishedSegments.push_back(cameraFilenames[fileCnt]);
+	ghSegmentMutex.unlock();
+}
 
+/*
+=================
+The function RollTrial closes the files of a camera at the end of a trial and opens the files of the next trial, <file>_trial<k>.tmp. It is called from the grab thread while the primary camera is held, so no frame of the new trial reaches the old file.
+=================
+*/
+int RollTrial(int fileCnt, string serialNumber, int trial)
+{
+	if (segmentFrames > 0)
+	{
+		FinishSegment(fileCnt);
 	}
-	catch (Spinnaker::Exception& e)
+	else
 	{
-		cout << "Error: " << e.what() << endl;
-		result = -1;
+		cameraSinks[fileCnt]->Close();
 	}
 
-	return result, widthToSet, heightToSet;
+	cameraBaseFilenames[fileCnt] = sessionDateTime + "_" + serialNumber + "_file" + to_string(fileCnt) + "_trial" + to_string(trial);
+	cameraSegments[fileCnt] = 0;
+	segmentFrameCnt[fileCnt] = 0;
+
+	if (OpenCameraFile(fileCnt) != 0)
+	{
+		cout << "Error opening trial file " << cameraFilenames[fileCnt] << " !" << endl;
+		return -1;
+	}
+	return 0;
 }
 
+int RollSegment(int fileCnt)
+{
+	FinishSegment(fileCnt);
+
+	cameraSegments[fileCnt]++;
+	segmentFrameCnt[fileCnt] = 0;
+
+	if (OpenCameraFile(fileCnt) != 0)
+	{
+		cout << "Error opening segment " << cameraFilenames[fileCnt] << " !" << endl;
+		return -1;
+	}
+	return 0;
+}
 
 /*
 =================
-The function ConfigureTrigger turns off trigger mode and then configures the trigger source for each camera. Once the trigger source has been selected, trigger mode is then enabled, which has the camera capture only a single image upon the execution of the chosen trigger. Note that chosenTrigger SOFTWARE/HARDWARE is chosen from outside the function. See resources here: https://www.flir.com/support-center/iis/machine-vision/application-note/configuring-synchronized-capture-with-multiple-cameras/
+The function GetIdleCpu returns the share of idle CPU time in percent since its previous call.
 =================
 */
-int ConfigureTrigger(INodeMap& nodeMap)
+double GetIdleCpu()
 {
-	int result = 0;
-	cout << endl << "*** CONFIGURING TRIGGER ***" << endl << endl;
+	static unsigned long long lastIdle = 0, lastTotal = 0;
+	unsigned long long idle = 0, total = 0;
 
-	if (chosenTrigger == SOFTWARE)
+#if defined(_WIN32)
+	FILETIME idleTime, kernelTime, userTime;
+	if (!GetSystemTimes(&idleTime, &kernelTime, &userTime))
 	{
-		cout << "Setting Software trigger:" << endl;
+		return 0.0;
 	}
-	else if (chosenTrigger == HARDWARE)
+	auto toULL = [](FILETIME t) { return ((unsigned long long)t.dwHighDateTime << 32) | t.dwLowDateTime; };
+	idle = toULL(idleTime);
+	total = toULL(kernelTime) + toULL(userTime); // kernel time includes idle time
+#else
+	ifstream stat("/proc/stat");
+	string cpu;
+	unsigned long long value;
+	stat >> cpu;
+	for (int field = 0; stat >> value && field < 8; field++)
 	{
-		cout << "Setting Hardware trigger:" << endl;
+		total += value;
+		if (field == 3 || field == 4) idle += value; // idle and iowait
 	}
+#endif
 
-	try
+	double idlePercent = (total > lastTotal) ? 100.0 * (idle - lastIdle) / (total - lastTotal) : 0.0;
+	lastIdle = idle;
+	lastTotal = total;
+	return idlePercent;
+}
+
+/*
+=================
+The function ParseCores turns a core list like 2,3,8-11 from grabCores or writerCores into core numbers. An entry nodeN stands for all cores of NUMA node N, which NumaNodeCores reads from the system.
+=================
+*/
+vector<int> NumaNodeCores(int node);
+
+vector<int> ParseCores(string list)
+{
+	vector<int> cores;
+	stringstream entries(list);
+	string entry;
+	while (getline(entries, entry, ','))
 	{
-		// Ensure trigger mode off
-		CEnumerationPtr ptrTriggerMode = nodeMap.GetNode("TriggerMode");
-		if (!IsAvailable(ptrTriggerMode) || !IsReadable(ptrTriggerMode))
+		if (entry.empty())
 		{
-			cout << "Unable to disable trigger mode (node retrieval). Aborting..." << endl;
-			return -1;
+			continue;
 		}
-
-		CEnumEntryPtr ptrTriggerModeOff = ptrTriggerMode->GetEntryByName("Off");
-		if (!IsAvailable(ptrTriggerModeOff) || !IsReadable(ptrTriggerModeOff))
+		if (entry.rfind("node", 0) == 0)
 		{
-			cout << "Unable to disable trigger mode (enum entry retrieval). Aborting..." << endl;
-			return -1;
+			vector<int> nodeCores = NumaNodeCores(std::stoi(entry.substr(4)));
+			cores.insert(cores.end(), nodeCores.begin(), nodeCores.end());
+			continue;
 		}
-		ptrTriggerMode->SetIntValue(ptrTriggerModeOff->GetValue());
-		cout << "1. Trigger mode disabled" << endl;
-
-		// Select trigger source
-		CEnumerationPtr ptrTriggerSource = nodeMap.GetNode("TriggerSource");
-		if (!IsAvailable(ptrTriggerSource) || !IsWritable(ptrTriggerSource))
+		size_t dash = entry.find('-');
+		int first = std::stoi(entry.substr(0, dash));
+		int last = (dash == string::npos) ? first : std::stoi(entry.substr(dash + 1));
+		for (int core = first; core <= last; core++)
 		{
-			cout << "Unable to set trigger mode (node retrieval). Aborting..." << endl;
-			return -1;
+			cores.push_back(core);
 		}
+	}
+	return cores;
+}
 
-		if (chosenTrigger == SOFTWARE)
-		{
-			// Set trigger mode to software
-			CEnumEntryPtr ptrTriggerSourceSoftware = ptrTriggerSource->GetEntryByName("Software");
-			if (!IsAvailable(ptrTriggerSourceSoftware) || !IsReadable(ptrTriggerSourceSoftware))
-			{
-				cout << "Unable to set trigger mode (enum entry retrieval). Aborting..." << endl;
-				return -1;
-			}
-			ptrTriggerSource->SetIntValue(ptrTriggerSourceSoftware->GetValue());
-			cout << "2. Trigger source set to software" << endl;
-
-			// Trigger mode not yet activated, initialized with BeginAcquisition
-		}
-		else if (chosenTrigger == HARDWARE)
+vector<int> NumaNodeCores(int node)
+{
+	vector<int> cores;
+#if defined(_WIN32)
+	ULONGLONG mask = 0;
+	if (GetNumaNodeProcessorMask((UCHAR)node, &mask))
+	{
+		for (int core = 0; core < 64; core++)
 		{
-			// Set trigger mode to hardware ('Line3')
-			CEnumEntryPtr ptrTriggerSourceHardware = ptrTriggerSource->GetEntryByName("Line3");
-			if (!IsAvailable(ptrTriggerSourceHardware) || !IsReadable(ptrTriggerSourceHardware))
-			{
-				cout << "Unable to set trigger mode (enum entry retrieval). Aborting..." << endl;
-				return -1;
-			}
-			ptrTriggerSource->SetIntValue(ptrTriggerSourceHardware->GetValue());
-			cout << "2. Trigger source set to hardware" << endl;
-
-			//Turn TriggerMode to ON for Hardware Trigger
-			CEnumEntryPtr ptrTriggerModeOn = ptrTriggerMode->GetEntryByName("On");
-			if (!IsAvailable(ptrTriggerModeOn) || !IsReadable(ptrTriggerModeOn))
-			{
-				cout << "Unable to enable trigger mode (enum entry retrieval). Aborting..." << endl;
-				return -1;
-			}
-			ptrTriggerMode->SetIntValue(ptrTriggerModeOn->GetValue());
-			cout << "3. Trigger mode activated" << endl;
+			if (mask & (1ULL << core)) cores.push_back(core);
 		}
 	}
-	catch (Spinnaker::Exception& e)
+#else
+	ifstream cpuList("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+	string list;
+	if (getline(cpuList, list))
 	{
-		cout << "Error: " << e.what() << endl;
-		result = -1;
+		cores = ParseCores(list);
 	}
-	return result;
+#endif
+	if (cores.empty())
+	{
+		cout << "Warning: NUMA node " << node << " has no cores!" << endl;
+	}
+	return cores;
 }
 
 /*
 =================
-The function ConfigureExposure sets the Exposure setting for the cameras. The Exposure time will affect the overall brightness of the image, but also the framerate. Note that *exposureTime* is set from outside the function. To reach a Frame Rate of 200fps each frame canot take longer than 1/200 = 5ms, thus restricting the exposure time to 5000 microseconds.
+The function PinCurrentThread restricts the calling thread to cores and, with realtime, raises it to THREAD_PRIORITY_TIME_CRITICAL on Windows or SCHED_FIFO elsewhere, which needs root or CAP_SYS_NICE. The FIFO priority stays below the threaded interrupt handlers at 50, so USB interrupts still reach the grab threads. Real-time grab threads only fill the frame ring, they never wait for ghMutex while a writer thread at normal priority holds it. It returns the layout that was actually applied, failures are printed as warnings and the thread keeps its default.
 =================
 */
-int ConfigureExposure(INodeMap& nodeMap)
+string PinCurrentThread(const vector<int>& cores, bool realtime)
 {
-	int result = 0;
-	cout << endl << "*** CONFIGURING EXPOSURE ***" << endl << endl;
-
-	try
+	string layout = "any core";
+	if (!cores.empty())
 	{
-		// Turn off automatic exposure mode
-		CEnumerationPtr ptrExposureAuto = nodeMap.GetNode("ExposureAuto");
-		if (!IsAvailable(ptrExposureAuto) || !IsWritable(ptrExposureAuto))
+		string coreList;
+		for (int core : cores)
 		{
-			cout << "Unable to disable automatic exposure (node retrieval). Aborting..." << endl << endl;
-			return -1;
+			coreList += (coreList.empty() ? "" : ",") + to_string(core);
 		}
-
-		CEnumEntryPtr ptrExposureAutoOff = ptrExposureAuto->GetEntryByName("Off");
-		if (!IsAvailable(ptrExposureAutoOff) || !IsReadable(ptrExposureAutoOff))
+#if defined(_WIN32)
+		DWORD_PTR mask = 0;
+		for (int core : cores)
 		{
-			cout << "Unable to disable automatic exposure (enum entry retrieval). Aborting..." << endl << endl;
+			mask |= (DWORD_PTR)1 << core;
+		}
+		bool pinned = SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		for (int core : cores)
+		{
+			CPU_SET(core, &mask);
+		}
+		bool pinned = pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#endif
+		if (pinned)
+		{
+			layout = (cores.size() == 1 ? "core " : "cores ") + coreList;
+		}
+		else
+		{
+			cout << "Warning: unable to pin thread to cores " << coreList << "!" << endl;
+		}
+	}
+
+	if (realtime)
+	{
+#if defined(_WIN32)
+		bool raised = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+		sched_param param = {};
+		param.sched_priority = 40;
+		bool raised = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+		if (raised)
+		{
+			layout += ", real-time priority";
+		}
+		else
+		{
+			cout << "Warning: unable to raise thread to real-time priority!" << endl;
+		}
+	}
+	return layout;
+}
+
+/*
+=================
+The function StartConverter launches BINtoAVI at low priority for one finished segment, using the metadata file written before recording started.
+=================
+*/
+#if defined(_WIN32)
+typedef HANDLE ConverterHandle;
+#else
+typedef pid_t ConverterHandle;
+#endif
+
+bool StartConverter(string segment, ConverterHandle& process)
+{
+	cout << "Converting segment " << segment << " in background..." << endl;
+
+#if defined(_WIN32)
+	string commandLine = "\"" + converterPath + "\" \"" + metadataFilename + "\" \"" + segment + "\" background";
+	STARTUPINFOA startupInfo = {};
+	startupInfo.cb = sizeof(startupInfo);
+	PROCESS_INFORMATION processInfo = {};
+	if (!CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, FALSE, IDLE_PRIORITY_CLASS | CREATE_NO_WINDOW, nullptr, nullptr, &startupInfo, &processInfo))
+	{
+		cout << "Unable to start " << converterPath << " for segment " << segment << endl;
+		return false;
+	}
+	CloseHandle(processInfo.hThread);
+	process = processInfo.hProcess;
+
+	// Child processes do not inherit the affinity of this thread on Windows
+	if (!writerCoreList.empty())
+	{
+		DWORD_PTR mask = 0;
+		for (int core : writerCoreList)
+		{
+			mask |= (DWORD_PTR)1 << core;
+		}
+		SetProcessAffinityMask(process, mask);
+	}
+#else
+	process = fork();
+	if (process == 0)
+	{
+		execl(converterPath.c_str(), converterPath.c_str(), metadataFilename.c_str(), segment.c_str(), "background", (char*)nullptr);
+		_exit(127);
+	}
+	if (process < 0)
+	{
+		cout << "Unable to start " << converterPath << " for segment " << segment << endl;
+		return false;
+	}
+#endif
+	return true;
+}
+
+bool ConverterRunning(ConverterHandle process)
+{
+#if defined(_WIN32)
+	if (WaitForSingleObject(process, 0) == WAIT_TIMEOUT)
+	{
+		return true;
+	}
+	CloseHandle(process);
+	return false;
+#else
+	return waitpid(process, nullptr, WNOHANG) == 0;
+#endif
+}
+
+/*
+=================
+The function ConvertSegmentsInBackground runs in its own thread during recording, on the writerCores. It starts at most converterJobs low priority BINtoAVI processes for finished segments, and only while the CPU is at least converterMinIdle percent idle and no grab thread reports write pressure. After recording it converts the remaining segments and returns once all conversions are done.
+=================
+*/
+void ConvertSegmentsInBackground()
+{
+	vector<ConverterHandle> running;
+	int converted = 0;
+
+	// Forked converters inherit the cores of this thread
+	if (!writerCoreList.empty())
+	{
+		PinCurrentThread(writerCoreList, false);
+	}
+
+	while (true)
+	{
+		// Drop conversions that have finished
+		running.erase(remove_if(running.begin(), running.end(), [](ConverterHandle process) { return !ConverterRunning(process); }), running.end());
+
+		ghSegmentMutex.lock();
+		bool queueEmpty = finishedSegments.empty();
+		ghSegmentMutex.unlock();
+
+		if (recordingDone && queueEmpty && running.empty())
+		{
+			break;
+		}
+
+		// Throttle while recording so that conversion never competes with grabbing and writing
+		double idleCpu = GetIdleCpu();
+		bool headroom = recordingDone || (idleCpu >= converterMinIdle && !writePressure);
+
+		if (!queueEmpty && (int)running.size() < converterJobs && headroom)
+		{
+			ghSegmentMutex.lock();
+			string segment = finishedSegments.front();
+			finishedSegments.erase(finishedSegments.begin());
+			ghSegmentMutex.unlock();
+
+			ConverterHandle process;
+			if (StartConverter(segment, process))
+			{
+				running.push_back(process);
+				converted++;
+			}
+		}
+
+		writePressure = false;
+		this_thread::sleep_for(milliseconds(500));
+	}
+
+	cout << "Background conversion finished for " << converted << " segments" << endl;
+}
+
+/*
+=================
+The function ImageSettings configures the image compression i.e., the actual image width and height.
+=================
+*/
+int ImageSettings(INodeMap& nodeMap, int& widthSet, int& heightSet, ostream& out)
+{
+	int result = 0;
+	out << endl << "*** CONFIGURING IMAGE SETTINGS ***" << endl << endl;
+
+	try
+	{
+		// TODO: update with decimation and or binning
+
+		// Set image width
+		CIntegerPtr ptrWidth = nodeMap.GetNode("Width");
+		if (IsAvailable(ptrWidth) && IsWritable(ptrWidth))
+		{
+			int width = ptrWidth->GetMax();
+			widthSet = width / compression;
+			ptrWidth->SetValue(widthSet);
+
+
+			out << "Width set to " << ptrWidth->GetValue() << "..." << endl;
+		}
+		else
+		{
+			out << "Width not available..." << endl;
+		}
+
+		// Set maximum height
+		CIntegerPtr ptrHeight = nodeMap.GetNode("Height");
+		if (IsAvailable(ptrHeight) && IsWritable(ptrHeight))
+		{
+			int height = ptrHeight->GetMax();
+			heightSet = height / compression;
+			ptrHeight->SetValue(heightSet);
+
+			out << "Height set to " << ptrHeight->GetValue() << "..." << endl << endl;
+		}
+		else
+		{
+			out << "Height not available..." << endl << endl;
+		}
+
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		out << "Error: " << e.what() << endl;
+		result = -1;
+	}
+
+	return result;
+}
+
+
+/*
+=================
+The function ConfigureTrigger turns off trigger mode and then configures the trigger source for each camera. Once the trigger source has been selected, trigger mode is then enabled, which has the camera capture only a single image upon the execution of the chosen trigger. Note that chosenTrigger SOFTWARE/HARDWARE is passed in by the caller. See resources here: https://www.flir.com/support-center/iis/machine-vision/application-note/configuring-synchronized-capture-with-multiple-cameras/
+=================
+*/
+int ConfigureTrigger(INodeMap& nodeMap, triggerType chosenTrigger, ostream& out)
+{
+	int result = 0;
+	out << endl << "*** CONFIGURING TRIGGER ***" << endl << endl;
+
+	if (chosenTrigger == SOFTWARE)
+	{
+		out << "Setting Software trigger:" << endl;
+	}
+	else if (chosenTrigger == HARDWARE)
+	{
+		out << "Setting Hardware trigger:" << endl;
+	}
+
+	try
+	{
+		// Ensure trigger mode off
+		CEnumerationPtr ptrTriggerMode = nodeMap.GetNode("TriggerMode");
+		if (!IsAvailable(ptrTriggerMode) || !IsReadable(ptrTriggerMode))
+		{
+			out << "Unable to disable trigger mode (node retrieval). Aborting..." << endl;
+			return -1;
+		}
+
+		CEnumEntryPtr ptrTriggerModeOff = ptrTriggerMode->GetEntryByName("Off");
+		if (!IsAvailable(ptrTriggerModeOff) || !IsReadable(ptrTriggerModeOff))
+		{
+			out << "Unable to disable trigger mode (enum entry retrieval). Aborting..." << endl;
+			return -1;
+		}
+		ptrTriggerMode->SetIntValue(ptrTriggerModeOff->GetValue());
+		out << "1. Trigger mode disabled" << endl;
+
+		// Select trigger source
+		CEnumerationPtr ptrTriggerSource = nodeMap.GetNode("TriggerSource");
+		if (!IsAvailable(ptrTriggerSource) || !IsWritable(ptrTriggerSource))
+		{
+			out << "Unable to set trigger mode (node retrieval). Aborting..." << endl;
+			return -1;
+		}
+
+		if (chosenTrigger == SOFTWARE)
+		{
+			// Set trigger mode to software
+			CEnumEntryPtr ptrTriggerSourceSoftware = ptrTriggerSource->GetEntryByName("Software");
+			if (!IsAvailable(ptrTriggerSourceSoftware) || !IsReadable(ptrTriggerSourceSoftware))
+			{
+				out << "Unable to set trigger mode (enum entry retrieval). Aborting..." << endl;
+				return -1;
+			}
+			ptrTriggerSource->SetIntValue(ptrTriggerSourceSoftware->GetValue());
+			out << "2. Trigger source set to software" << endl;
+
+			// Hold the primary camera in trigger mode until all cameras are armed, see StartPrimaryTrigger
+			CEnumEntryPtr ptrTriggerModeOn = ptrTriggerMode->GetEntryByName("On");
+			if (!IsAvailable(ptrTriggerModeOn) || !IsReadable(ptrTriggerModeOn))
+			{
+				out << "Unable to enable trigger mode (enum entry retrieval). Aborting..." << endl;
+				return -1;
+			}
+			ptrTriggerMode->SetIntValue(ptrTriggerModeOn->GetValue());
+			out << "3. Trigger mode activated, free running starts with recording" << endl;
+		}
+		else if (chosenTrigger == HARDWARE)
+		{
+			// Set trigger mode to hardware ('Line3')
+			CEnumEntryPtr ptrTriggerSourceHardware = ptrTriggerSource->GetEntryByName("Line3");
+			if (!IsAvailable(ptrTriggerSourceHardware) || !IsReadable(ptrTriggerSourceHardware))
+			{
+				out << "Unable to set trigger mode (enum entry retrieval). Aborting..." << endl;
+				return -1;
+			}
+			ptrTriggerSource->SetIntValue(ptrTriggerSourceHardware->GetValue());
+			out << "2. Trigger source set to hardware" << endl;
+
+			//Turn TriggerMode to ON for Hardware Trigger
+			CEnumEntryPtr ptrTriggerModeOn = ptrTriggerMode->GetEntryByName("On");
+			if (!IsAvailable(ptrTriggerModeOn) || !IsReadable(ptrTriggerModeOn))
+			{
+				out << "Unable to enable trigger mode (enum entry retrieval). Aborting..." << endl;
+				return -1;
+			}
+			ptrTriggerMode->SetIntValue(ptrTriggerModeOn->GetValue());
+			out << "3. Trigger mode activated" << endl;
+		}
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		out << "Error: " << e.what() << endl;
+		result = -1;
+	}
+	return result;
+}
+
+/*
+=================
+The function ConfigureExposure sets the Exposure setting for the cameras. The Exposure time will affect the overall brightness of the image, but also the framerate. Note that *exposureTime* is set from outside the function. To reach a Frame Rate of 200fps each frame canot take longer than 1/200 = 5ms, thus restricting the exposure time to 5000 microseconds.
+=================
+*/
+int ConfigureExposure(INodeMap& nodeMap, double& frameRate, ostream& out)
+{
+	int result = 0;
+	out << endl << "*** CONFIGURING EXPOSURE ***" << endl << endl;
+
+	try
+	{
+		// Turn off automatic exposure mode
+		CEnumerationPtr ptrExposureAuto = nodeMap.GetNode("ExposureAuto");
+		if (!IsAvailable(ptrExposureAuto) || !IsWritable(ptrExposureAuto))
+		{
+			out << "Unable to disable automatic exposure (node retrieval). Aborting..." << endl << endl;
+			return -1;
+		}
+
+		CEnumEntryPtr ptrExposureAutoOff = ptrExposureAuto->GetEntryByName("Off");
+		if (!IsAvailable(ptrExposureAutoOff) || !IsReadable(ptrExposureAutoOff))
+		{
+			out << "Unable to disable automatic exposure (enum entry retrieval). Aborting..." << endl << endl;
 			return -1;
 		}
 		ptrExposureAuto->SetIntValue(ptrExposureAutoOff->GetValue());
@@ -421,7 +1199,7 @@ int ConfigureExposure(INodeMap& nodeMap)
 		CFloatPtr ptrExposureTime = nodeMap.GetNode("ExposureTime");
 		if (!IsAvailable(ptrExposureTime) || !IsWritable(ptrExposureTime))
 		{
-			cout << "Unable to set exposure time. Aborting..." << endl << endl;
+			out << "Unable to set exposure time. Aborting..." << endl << endl;
 			return -1;
 		}
 
@@ -434,26 +1212,26 @@ int ConfigureExposure(INodeMap& nodeMap)
 			exposureTimeToSet = exposureTimeMax;
 		}
 		ptrExposureTime->SetValue(exposureTimeToSet);
-		cout << std::fixed << "Exposure time set to " << exposureTimeToSet << " microseconds" << endl;
+		out << std::fixed << "Exposure time set to " << exposureTimeToSet << " microseconds" << endl;
 
 		//checking the frame rate
-		cout << endl << "*** CONFIGURING FRAMERATE ***" << endl << endl;
+		out << endl << "*** CONFIGURING FRAMERATE ***" << endl << endl;
 		CFloatPtr ptrAcquisitionFrameRate = nodeMap.GetNode("AcquisitionFrameRate");
 		if (!IsAvailable(ptrAcquisitionFrameRate) || !IsReadable(ptrAcquisitionFrameRate))
 		{
-			cout << "Unable to get node AcquisitionFrameRate. Aborting..." << endl << endl;
+			out << "Unable to get node AcquisitionFrameRate. Aborting..." << endl << endl;
 			return -1;
 		}
 		ptrAcquisitionFrameRate->SetValue(ptrAcquisitionFrameRate->GetMax());
 		double testAcqFrameRate = ptrAcquisitionFrameRate->GetValue();
-		cout << "Acquisition Frame Rate is  : " << testAcqFrameRate << endl;
-		cout << "Maximum Acquisition Frame Rate is  : " << ptrAcquisitionFrameRate->GetMax() << endl;
+		out << "Acquisition Frame Rate is  : " << testAcqFrameRate << endl;
+		out << "Maximum Acquisition Frame Rate is  : " << ptrAcquisitionFrameRate->GetMax() << endl;
 
 		//checking the resulting FrameRate on the system after setting th exposure time:
 		CFloatPtr ptrResultingAcquisitionFrameRate = nodeMap.GetNode("AcquisitionResultingFrameRate");
 		if (!IsAvailable(ptrResultingAcquisitionFrameRate) || !IsReadable(ptrResultingAcquisitionFrameRate))
 		{
-			cout << "Unable to get node ResultingAcquisitionFrameRate. Aborting..." << endl << endl;
+			out << "Unable to get node ResultingAcquisitionFrameRate. Aborting..." << endl << endl;
 			return -1;
 		}
 		double testResultingAcqFrameRate = ptrResultingAcquisitionFrameRate->GetValue();
@@ -463,22 +1241,22 @@ int ConfigureExposure(INodeMap& nodeMap)
 		if (FPSToSet > testResultingAcqFrameRate)
 		{
 			FPSToSet = testResultingAcqFrameRate;
-			cout << "Chosen FPS to high, setting to max" << endl;
+			out << "Chosen FPS to high, setting to max" << endl;
 		}
 
 		// set chosen FPS
 		ptrAcquisitionFrameRate->SetValue(FPSToSet);
 
-		NewFrameRate = ptrAcquisitionFrameRate->GetValue();
-		cout << "New acquisition Frame Rate is  : " << NewFrameRate << endl;
+		frameRate = ptrAcquisitionFrameRate->GetValue();
+		out << "New acquisition Frame Rate is  : " << frameRate << endl;
 
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Error: " << e.what() << endl;
+		out << "Error: " << e.what() << endl;
 		result = -1;
 	}
-	return result, NewFrameRate;
+	return result;
 }
 
 /*
@@ -486,10 +1264,10 @@ int ConfigureExposure(INodeMap& nodeMap)
 The function ConfigureStrobe sets the triggering mode between cameras by selecting the strobe signal from one camera as the trigger input for the other cameras. The Output line and line mode settings are affected by the trigger settings above. See resources here: https://www.flir.com/support-center/iis/machine-vision/application-note/configuring-synchronized-capture-with-multiple-cameras/
 =================
 */
-int ConfigureStrobe(CameraPtr pCam, INodeMap& nodeMap)
+int ConfigureStrobe(CameraPtr pCam, INodeMap& nodeMap, ostream& out)
 {
 	int result = 0;
-	cout << endl << "*** CONFIGURING STROBE ***" << endl << endl;
+	out << endl << "*** CONFIGURING STROBE ***" << endl << endl;
 
 	try
 	{
@@ -497,54 +1275,54 @@ int ConfigureStrobe(CameraPtr pCam, INodeMap& nodeMap)
 		Spinnaker::GenApi::CEnumerationPtr ptrLineSelector = nodeMap.GetNode("LineSelector");
 		if (!IsAvailable(ptrLineSelector) || !IsWritable(ptrLineSelector))
 		{
-			cout << "Unable to set Lineselector  (node retrieval). Aborting..." << endl << endl;
+			out << "Unable to set Lineselector  (node retrieval). Aborting..." << endl << endl;
 			return -1;
 		}
 		Spinnaker::GenApi::CEnumEntryPtr ptrLine2 = ptrLineSelector->GetEntryByName("Line2");
 		if (!IsAvailable(ptrLine2) || !IsReadable(ptrLine2))
 		{
-			cout << "Unable to get Line2  (node retrieval). Aborting..." << endl << endl;
+			out << "Unable to get Line2  (node retrieval). Aborting..." << endl << endl;
 			return -1;
 		}
 		ptrLineSelector->SetIntValue(ptrLine2->GetValue());
 
-		cout << "Selected LineSelector is Line:  " << ptrLineSelector->GetCurrentEntry()->GetSymbolic() << endl;
+		out << "Selected LineSelector is Line:  " << ptrLineSelector->GetCurrentEntry()->GetSymbolic() << endl;
 
 		// Line Mode
 		CEnumerationPtr ptrLineMode = nodeMap.GetNode("LineMode");
 		if (!IsAvailable(ptrLineMode) || !IsWritable(ptrLineMode))
 		{
-			cout << "Unable to get Line Mode(node retrieval). Aborting..." << endl << endl;
+			out << "Unable to get Line Mode(node retrieval). Aborting..." << endl << endl;
 			return -1;
 		}
 		CEnumEntryPtr ptrOutput = ptrLineMode->GetEntryByName("Output");
 		if (!IsAvailable(ptrOutput) || !IsReadable(ptrOutput))
 		{
-			cout << "Unable to get Output  (node retrieval). Aborting..." << endl << endl;
+			out << "Unable to get Output  (node retrieval). Aborting..." << endl << endl;
 			return -1;
 		}
 		ptrLineMode->SetIntValue(ptrOutput->GetValue());
-		cout << "Selected LineMode is:  " << ptrLineMode->GetCurrentEntry()->GetSymbolic() << endl;
+		out << "Selected LineMode is:  " << ptrLineMode->GetCurrentEntry()->GetSymbolic() << endl;
 
 		//  LineSource 
 		CEnumerationPtr ptrLineSource = nodeMap.GetNode("LineSource");
 		if (!IsAvailable(ptrLineSource) || !IsWritable(ptrLineSource))
 		{
-			cout << "Unable to get Line Source (node retrieval). Aborting..." << endl << endl;
+			out << "Unable to get Line Source (node retrieval). Aborting..." << endl << endl;
 			return -1;
 		}
 		CEnumEntryPtr ptrEntryLineSource = ptrLineSource->GetEntryByName("ExposureActive");
 		if (!IsAvailable(ptrEntryLineSource) || !IsReadable(ptrEntryLineSource))
 		{
-			cout << "Unable to get Output  (node retrieval). Aborting..." << endl << endl;
+			out << "Unable to get Output  (node retrieval). Aborting..." << endl << endl;
 			return -1;
 		}
 		ptrLineSource->SetIntValue(ptrEntryLineSource->GetValue());
-		cout << "Selected LineSource  is:  " << ptrLineSource->GetCurrentEntry()->GetSymbolic() << endl;
+		out << "Selected LineSource  is:  " << ptrLineSource->GetCurrentEntry()->GetSymbolic() << endl;
 	}
 	catch (Spinnaker::Exception& e)
 	{
-		cout << "Error: " << e.what() << endl;
+		out << "Error: " << e.what() << endl;
 		result = -1;
 	}
 	return result;
@@ -552,60 +1330,145 @@ int ConfigureStrobe(CameraPtr pCam, INodeMap& nodeMap)
 
 /*
 =================
-The function BufferHandlingSettings sets manual buffer handling mode to numBuffers set above.
+The struct ChunkLayout tells which chunks a camera delivers with every image, only these are decoded by DecodeFrame. The function ConfigureChunkData activates chunk mode and enables only the chunks RECtoBIN logs, FrameID, Timestamp, ExposureTime, Gain and ExposureEndLineStatusAll, all others are disabled to keep the payload small. It marks each chunk it could enable in chunks. A camera without chunk mode records without chunk data, this is only a warning.
 =================
 */
-int BufferHandlingSettings(CameraPtr pCam)
+struct ChunkLayout
 {
-	int result = 0;
-	cout << endl << "*** CONFIGURING BUFFER ***" << endl << endl;
+	bool frameID = false;
+	bool timestamp = false;
+	bool exposureTime = false;
+	bool gain = false;
+	bool lineStatus = false;
 
-	// Retrieve Stream Parameters device nodemap
-	Spinnaker::GenApi::INodeMap& sNodeMap = pCam->GetTLStreamNodeMap();
+	bool Any() const
+	{
+		return frameID || timestamp || exposureTime || gain || lineStatus;
+	}
+};
 
-	// Retrieve Buffer Handling Mode Information
-	CEnumerationPtr ptrHandlingMode = sNodeMap.GetNode("StreamBufferHandlingMode");
-	if (!IsAvailable(ptrHandlingMode) || !IsWritable(ptrHandlingMode))
+int ConfigureChunkData(INodeMap& nodeMap, ChunkLayout& chunks, ostream& out)
+{
+	out << endl << "*** CONFIGURING CHUNK DATA ***" << endl << endl;
+	chunks = ChunkLayout();
+
+	const vector<string> chunkNames = { "FrameID", "Timestamp", "ExposureTime", "Gain", "ExposureEndLineStatusAll" };
+
+	CBooleanPtr ptrChunkModeActive = nodeMap.GetNode("ChunkModeActive");
+	if (!IsAvailable(ptrChunkModeActive) || !IsWritable(ptrChunkModeActive))
 	{
-		cout << "Unable to set Buffer Handling mode (node retrieval). Aborting..." << endl << endl;
-		return -1;
+		out << "Warning: unable to activate chunk mode, recording without chunk data!" << endl;
+		return 0;
 	}
+	ptrChunkModeActive->SetValue(true);
 
-	CEnumEntryPtr ptrHandlingModeEntry = ptrHandlingMode->GetCurrentEntry();
-	if (!IsAvailable(ptrHandlingModeEntry) || !IsReadable(ptrHandlingModeEntry))
+	CEnumerationPtr ptrChunkSelector = nodeMap.GetNode("ChunkSelector");
+	if (!IsAvailable(ptrChunkSelector) || !IsReadable(ptrChunkSelector))
 	{
-		cout << "Unable to set Buffer Handling mode (Entry retrieval). Aborting..." << endl << endl;
-		return -1;
+		out << "Warning: unable to retrieve chunk selector, recording without chunk data!" << endl;
+		return 0;
 	}
 
-	// Set stream buffer Count Mode to manual
-	CEnumerationPtr ptrStreamBufferCountMode = sNodeMap.GetNode("StreamBufferCountMode");
-	if (!IsAvailable(ptrStreamBufferCountMode) || !IsWritable(ptrStreamBufferCountMode))
+	NodeList_t entries;
+	ptrChunkSelector->GetEntries(entries);
+	int enabled = 0;
+	for (size_t i = 0; i < entries.size(); i++)
 	{
-		cout << "Unable to set Buffer Count Mode (node retrieval). Aborting..." << endl << endl;
-		return -1;
+		CEnumEntryPtr ptrChunkSelectorEntry = entries.at(i);
+		if (!IsAvailable(ptrChunkSelectorEntry) || !IsReadable(ptrChunkSelectorEntry))
+		{
+			continue;
+		}
+		ptrChunkSelector->SetIntValue(ptrChunkSelectorEntry->GetValue());
+
+		// The image itself is a chunk as well and stays enabled
+		string chunkName = ptrChunkSelectorEntry->GetSymbolic().c_str();
+		CBooleanPtr ptrChunkEnable = nodeMap.GetNode("ChunkEnable");
+		if (chunkName == "Image" || !IsAvailable(ptrChunkEnable) || !IsWritable(ptrChunkEnable))
+		{
+			continue;
+		}
+
+		bool wanted = find(chunkNames.begin(), chunkNames.end(), chunkName) != chunkNames.end();
+		ptrChunkEnable->SetValue(wanted);
+		if (!wanted)
+		{
+			continue;
+		}
+		out << "Chunk " << chunkName << " enabled" << endl;
+		enabled++;
+
+		if (chunkName == "FrameID") chunks.frameID = true;
+		else if (chunkName == "Timestamp") chunks.timestamp = true;
+		else if (chunkName == "ExposureTime") chunks.exposureTime = true;
+		else if (chunkName == "Gain") chunks.gain = true;
+		else if (chunkName == "ExposureEndLineStatusAll") chunks.lineStatus = true;
 	}
 
-	CEnumEntryPtr ptrStreamBufferCountModeManual = ptrStreamBufferCountMode->GetEntryByName("Manual");
-	if (!IsAvailable(ptrStreamBufferCountModeManual) || !IsReadable(ptrStreamBufferCountModeManual))
+	// Missing chunks are left empty in the csv file, FrameID and Timestamp are then taken from the image
+	if (enabled < (int)chunkNames.size())
 	{
-		cout << "Unable to set Buffer Count Mode entry (Entry retrieval). Aborting..." << endl << endl;
-		return -1;
+		out << "Warning: only " << enabled << " of " << chunkNames.size() << " chunks are available!" << endl;
 	}
-	ptrStreamBufferCountMode->SetIntValue(ptrStreamBufferCountModeManual->GetValue());
+	return 0;
+}
+
+/*
+=================
+The function BufferHandlingSettings sets manual buffer handling mode to numBuffers set above. With bufferSeconds the count is replaced by PlanCameraMemory once all cameras are configured.
+=================
+*/
+int BufferHandlingSettings(CameraPtr pCam, ostream& out)
+{
+	int result = 0;
+	out << endl << "*** CONFIGURING BUFFER ***" << endl << endl;
+
+	// Retrieve Stream Parameters device nodemap
+	Spinnaker::GenApi::INodeMap& sNodeMap = pCam->GetTLStreamNodeMap();
+
+	// Retrieve Buffer Handling Mode Information
+	CEnumerationPtr ptrHandlingMode = sNodeMap.GetNode("StreamBufferHandlingMode");
+	if (!IsAvailable(ptrHandlingMode) || !IsWritable(ptrHandlingMode))
+	{
+		out << "Unable to set Buffer Handling mode (node retrieval). Aborting..." << endl << endl;
+		return -1;
+	}
+
+	CEnumEntryPtr ptrHandlingModeEntry = ptrHandlingMode->GetCurrentEntry();
+	if (!IsAvailable(ptrHandlingModeEntry) || !IsReadable(ptrHandlingModeEntry))
+	{
+		out << "Unable to set Buffer Handling mode (Entry retrieval). Aborting..." << endl << endl;
+		return -1;
+	}
+
+	// Set stream buffer Count Mode to manual
+	CEnumerationPtr ptrStreamBufferCountMode = sNodeMap.GetNode("StreamBufferCountMode");
+	if (!IsAvailable(ptrStreamBufferCountMode) || !IsWritable(ptrStreamBufferCountMode))
+	{
+		out << "Unable to set Buffer Count Mode (node retrieval). Aborting..." << endl << endl;
+		return -1;
+	}
+
+	CEnumEntryPtr ptrStreamBufferCountModeManual = ptrStreamBufferCountMode->GetEntryByName("Manual");
+	if (!IsAvailable(ptrStreamBufferCountModeManual) || !IsReadable(ptrStreamBufferCountModeManual))
+	{
+		out << "Unable to set Buffer Count Mode entry (Entry retrieval). Aborting..." << endl << endl;
+		return -1;
+	}
+	ptrStreamBufferCountMode->SetIntValue(ptrStreamBufferCountModeManual->GetValue());
 
 	// Retrieve and modify Stream Buffer Count
 	CIntegerPtr ptrBufferCount = sNodeMap.GetNode("StreamBufferCountManual");
 	if (!IsAvailable(ptrBufferCount) || !IsWritable(ptrBufferCount))
 	{
-		cout << "Unable to set Buffer Count (Integer node retrieval). Aborting..." << endl << endl;
+		out << "Unable to set Buffer Count (Integer node retrieval). Aborting..." << endl << endl;
 		return -1;
 	}
 
 	// Display Buffer Info
-	cout << "Stream Buffer Count Mode set to manual" << endl;
-	cout << "Default Buffer Count: " << ptrBufferCount->GetValue() << endl;
-	cout << "Maximum Buffer Count: " << ptrBufferCount->GetMax() << endl;
+	out << "Stream Buffer Count Mode set to manual" << endl;
+	out << "Default Buffer Count: " << ptrBufferCount->GetValue() << endl;
+	out << "Maximum Buffer Count: " << ptrBufferCount->GetMax() << endl;
 	if (ptrBufferCount->GetMax() < numBuffers)
 	{
 		ptrBufferCount->SetValue(ptrBufferCount->GetMax());
@@ -615,317 +1478,3223 @@ int BufferHandlingSettings(CameraPtr pCam)
 		ptrBufferCount->SetValue(numBuffers);
 	}
 
-	cout << "Manual Buffer Count: " << ptrBufferCount->GetValue() << endl;
-	ptrHandlingModeEntry = ptrHandlingMode->GetEntryByName("OldestFirst");
-	ptrHandlingMode->SetIntValue(ptrHandlingModeEntry->GetValue());
-	cout << "Buffer Handling Mode has been set to " << ptrHandlingModeEntry->GetDisplayName() << endl;
+	out << "Manual Buffer Count: " << ptrBufferCount->GetValue() << endl;
+	ptrHandlingModeEntry = ptrHandlingMode->GetEntryByName("OldestFirst");
+	ptrHandlingMode->SetIntValue(ptrHandlingModeEntry->GetValue());
+	out << "Buffer Handling Mode has been set to " << ptrHandlingModeEntry->GetDisplayName() << endl;
+
+	return result;
+}
+
+/*
+=================
+The struct FrameRecord describes one grabbed image with its original FrameID and camera timestamp, the host time at which it was grabbed and the trial it belongs to. With chunk data it also holds the exposure time, gain and input line status the camera reported for this image. The struct FrameRing is the preallocated pre-trigger RAM ring of one camera. The grab thread copies images into the slot at head and the writer thread takes them at tail, both indices only grow, so the ring needs no lock.
+=================
+*/
+struct FrameRecord
+{
+	uint64_t frameID = 0;
+	uint64_t timestamp = 0; // camera timestamp in nanoseconds
+	int64_t hostTime = 0; // steady clock nanoseconds at grab
+	int64_t systemTime = 0; // system time in nanoseconds since 1970 at grab
+	size_t size = 0;
+	int trial = 1;
+	float exposureTime = 0; // microseconds, from chunk data
+	float gain = 0; // dB, from chunk data
+	uint32_t lineStatus = 0; // bit n = state of line n at the end of exposure, from chunk data
+};
+
+struct FrameRing
+{
+	vector<char> data; // slots x slotSize bytes
+	vector<FrameRecord> records;
+	size_t slotSize = 0;
+	uint64_t slots = 0;
+	std::atomic<uint64_t> head{ 0 }; // images pushed by the grab thread
+	std::atomic<uint64_t> tail{ 0 }; // images taken by the writer thread
+	std::atomic<bool> closed{ false }; // set once the grab thread has finished
+	std::atomic<uint64_t> overruns{ 0 }; // images lost because the ring was full
+	uint64_t committed = 0;
+	uint64_t dropped = 0;
+};
+
+/*
+=================
+The function DecodeFrame fills the record of one grabbed image. The frame counter, timestamp, exposure time, gain and line status come from the chunk the camera appended to the image, decoded in one pass without node map access. Only the chunks in the ChunkLayout of the camera are read, FrameID and timestamp come from the image if their chunk is missing.
+=================
+*/
+void DecodeFrame(const ImagePtr& image, const ChunkLayout& chunks, FrameRecord& record)
+{
+	record.size = image->GetImageSize();
+	if (!chunks.Any())
+	{
+		record.frameID = image->GetFrameID();
+		record.timestamp = image->GetTimeStamp();
+		return;
+	}
+
+	const ChunkData& chunk = image->GetChunkData();
+	record.frameID = chunks.frameID ? (uint64_t)chunk.GetFrameID() : image->GetFrameID();
+	record.timestamp = chunks.timestamp ? (uint64_t)chunk.GetTimestamp() : image->GetTimeStamp();
+	if (chunks.exposureTime)
+	{
+		record.exposureTime = (float)chunk.GetExposureTime();
+	}
+	if (chunks.gain)
+	{
+		record.gain = (float)chunk.GetGain();
+	}
+	if (chunks.lineStatus)
+	{
+		record.lineStatus = (uint32_t)chunk.GetExposureEndLineStatusAll();
+	}
+}
+
+/*
+=================
+The struct GrabJitter collects the timing of the grab loop of one camera. For consecutive frames the jitter is the interval between their arrival on the host minus their interval on the camera clock, so it measures only the delay added by USB, driver and thread scheduling, independent of the frame rate and of pauses between trials.
+=================
+*/
+struct GrabJitter
+{
+	uint64_t frames = 0;
+	double sumUs = 0;
+	double sumSquaresUs = 0;
+	double maxUs = 0;
+	uint64_t lastFrameID = 0;
+	uint64_t lastTimestamp = 0;
+	int64_t lastHostTime = 0;
+
+	void Add(const FrameRecord& record)
+	{
+		if (lastHostTime != 0 && record.frameID == lastFrameID + 1)
+		{
+			double jitterUs = ((record.hostTime - lastHostTime) - (int64_t)(record.timestamp - lastTimestamp)) / 1000.0;
+			frames++;
+			sumUs += jitterUs;
+			sumSquaresUs += jitterUs * jitterUs;
+			maxUs = max(maxUs, fabs(jitterUs));
+		}
+		lastFrameID = record.frameID;
+		lastTimestamp = record.timestamp;
+		lastHostTime = record.hostTime;
+	}
+};
+
+/*
+=================
+The struct DeliveryLatency collects how long the frames of one camera take from exposure to the file, for comparing the acquisition modes. It is only filled with latencyBenchmark = 1. Camera and host clocks have an unknown offset, so each latency is counted from the fastest delivery of the recording: the smallest difference between host arrival time and camera timestamp. Time spent in the stream buffer, in GetNextImage or in the frame queue all shows up as latency. The percentiles come from a uniform random sample of LATENCY_SAMPLES frames, allocated once in Start, so Add never allocates while the caller holds ghMutex. The maximum is taken over all frames.
+=================
+*/
+const size_t LATENCY_SAMPLES = 65536;
+
+struct DeliveryLatency
+{
+	vector<int64_t> writtenNs; // sample of host time after writing minus camera timestamp
+	uint64_t frames = 0;
+	int64_t slowestNs = INT64_MIN; // largest host time after writing minus camera timestamp
+	int64_t fastestNs = INT64_MAX; // smallest host arrival time minus camera timestamp
+	uint64_t random = 0x9E3779B97F4A7C15ull;
+
+	void Start()
+	{
+		writtenNs.reserve(LATENCY_SAMPLES);
+	}
+
+	void Add(const FrameRecord& record, int64_t writtenHostTime)
+	{
+		const int64_t latency = writtenHostTime - (int64_t)record.timestamp;
+		fastestNs = min(fastestNs, record.hostTime - (int64_t)record.timestamp);
+		slowestNs = max(slowestNs, latency);
+		frames++;
+
+		// Reservoir sampling, every frame ends up in the sample with the same chance
+		if (writtenNs.size() < LATENCY_SAMPLES)
+		{
+			writtenNs.push_back(latency);
+			return;
+		}
+		random ^= random << 13;
+		random ^= random >> 7;
+		random ^= random << 17;
+		uint64_t slot = random % frames;
+		if (slot < LATENCY_SAMPLES)
+		{
+			writtenNs[slot] = latency;
+		}
+	}
+};
+
+/*
+=================
+The struct CameraSession holds one camera from configuration through recording. The camera is initialized once in ConfigureCamera, armed once in ArmCameraSessions and only deinitialized in CloseCameraSessions. ConfigureCamera runs in its own thread, so its console output is collected in log and printed after all cameras are done.
+=================
+*/
+struct CameraSession
+{
+	CameraPtr pCam;
+	unsigned int cameraCnt = 0;
+	string serialNumber;
+	bool primary = false;
+	std::atomic<bool> armed{ false }; // cleared by the grab thread, read by commands
+	std::atomic<bool> grabFinished{ false }; // set once AcquireImages has returned
+	std::atomic<int> trial{ 1 }; // trial the camera files currently belong to
+	std::atomic<uint64_t> framesWritten{ 0 };
+	std::atomic<uint64_t> lastFrameID{ 0 }; // FrameID of the last written image, read for event markers
+	std::atomic<int64_t> lastGrabNs{ 0 }; // host time of the last grabbed image, 0 = none yet
+	std::atomic<uint64_t> lastGrabFrameID{ 0 }; // FrameID of the last grabbed image, the trigger pulse count of this camera
+	FrameRing ring; // only allocated with preTriggerSeconds > 0 or acquisitionMode = event
+	bool bayer = false; // BayerRG8 raw images, otherwise Mono8
+	ChunkLayout chunks; // chunks the images carry, see ConfigureChunkData
+	vector<uint8_t> previewScratch;
+	int result = 0;
+	double frameRate = 0.0;
+	int width = 0;
+	int height = 0;
+	double seconds = 0.0;
+	int grabCore = -1; // core of the grab thread from grabCores, -1 = any core
+	string grabLayout; // layout the grab thread actually got
+	int grabResult = 1; // return value of AcquireImages, 0 = errors
+	int writerResult = 1; // return value of WriteFramesFromRing
+	GrabJitter jitter; // only updated by the grab thread or the image events, read after recording
+	DeliveryLatency latency; // only updated by the thread that commits the frames
+	stringstream log;
+};
+
+/*
+=================
+The function HostTimeNs returns the steady clock in nanoseconds, the time base of the frame queues. SystemTimeNs returns the system time in nanoseconds since 1970 for the SystemTimeInNanoseconds column. The function OpenCommitWindow is called for a trigger event on the trigger pulse eventFrame, it commits all frames from preTriggerSeconds before until postTriggerSeconds after the event. The window is kept in FrameIDs, all cameras count the same trigger pulses, so cameras that receive the same pulse at slightly different host times still commit the same frames. An event inside a running window extends it, a later event opens a new window in commitWindows, the earlier one stays until all ring writers have saved it. FrameAtHostTime maps a host time to a trigger pulse by the last image of the primary camera.
+=================
+*/
+int64_t HostTimeNs()
+{
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t SystemTimeNs()
+{
+	return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+void OpenCommitWindow(int64_t eventFrame)
+{
+	commitWindows.Open(eventFrame, llround(preTriggerSeconds * NewFrameRate), llround(postTriggerSeconds * NewFrameRate));
+}
+
+int64_t FrameAtHostTime(vector<CameraSession>& sessions, int64_t hostTime)
+{
+	CameraSession* reference = &sessions.front();
+	for (CameraSession& session : sessions)
+	{
+		if (session.primary)
+		{
+			reference = &session;
+		}
+	}
+
+	// Trigger pulses since the last image, none yet counts from FrameID 0
+	int64_t lastGrab = reference->lastGrabNs.load(memory_order_acquire);
+	int64_t lastFrameID = (int64_t)reference->lastGrabFrameID.load(memory_order_relaxed);
+	if (lastGrab == 0)
+	{
+		return 0;
+	}
+	return lastFrameID + llround((double)(hostTime - lastGrab) * NewFrameRate / 1e9);
+}
+
+/*
+=================
+The struct ActivityGate holds the motion detector on the frames of gateCamera. The function UpdateActivityGate downscales each frame by gateScale with BoxDownscale and takes the mean absolute difference to the previous frame as motion energy. The gate opens above gateOn and closes below gateOff, while it is open every frame opens a commit window, so all cameras save the pre-roll from their rings and continue until postTriggerSeconds after the last active frame. It runs in the ring writer of gateCamera, the time per frame is reported after recording.
+=================
+*/
+struct ActivityGate
+{
+	vector<uint8_t> previous;
+	vector<uint8_t> current;
+	bool hasPrevious = false;
+	bool open = false;
+	int activations = 0;
+	uint64_t frames = 0;
+	double totalMs = 0.0;
+	double maxMs = 0.0;
+};
+
+ActivityGate activityGate;
+
+void UpdateActivityGate(const char* imageData, int width, int height, uint64_t frameID)
+{
+	auto gateStart = steady_clock::now();
+	ActivityGate& gate = activityGate;
+
+	// Raw Bayer frames are treated as gray, an even gateScale averages whole RGGB blocks
+	const int smallWidth = width / gateScale;
+	const int smallHeight = height / gateScale;
+	gate.current.resize((size_t)smallWidth * smallHeight);
+	BoxDownscale(reinterpret_cast<const uint8_t*>(imageData), width, height, 1, gateScale, gate.current.data(), smallWidth);
+
+	if (gate.hasPrevious)
+	{
+		double energy = MeanAbsDifference(gate.current.data(), gate.previous.data(), gate.current.size());
+		if (!gate.open && energy >= gateOn)
+		{
+			gate.open = true;
+			gate.activations++;
+			cout << "Activity gate opened, motion energy " << energy << endl;
+		}
+		else if (gate.open && energy < gateOff)
+		{
+			gate.open = false;
+			cout << "Activity gate closed, motion energy " << energy << endl;
+		}
+
+		if (gate.open)
+		{
+			OpenCommitWindow((int64_t)frameID);
+		}
+	}
+	gate.previous.swap(gate.current);
+	gate.hasPrevious = true;
+
+	double gateMs = duration<double, milli>(steady_clock::now() - gateStart).count();
+	gate.frames++;
+	gate.totalMs += gateMs;
+	gate.maxMs = max(gate.maxMs, gateMs);
+}
+
+/*
+=================
+The function DecideCommit tells the ring writer of camera cameraCnt what to do with its oldest frame, by its FrameID. Frames inside a pending commit window are committed. Frames more than preTriggerSeconds behind the last grabbed frame of the camera can not be reached by a later event and are dropped, younger frames are held in the ring. Once the grab thread has finished, frames outside the windows are dropped right away.
+=================
+*/
+commitDecision DecideCommit(int cameraCnt, uint64_t frameID, uint64_t lastGrabFrameID, bool closing)
+{
+	// Without pre-trigger ring the frame queue of image events is saved completely
+	if (preTriggerSeconds <= 0)
+	{
+		return COMMIT;
+	}
+
+	// 2 frames and 10 ms guard for an event that is being stored right now or was mapped from a late image
+	const int64_t preTriggerFrames = llround(preTriggerSeconds * NewFrameRate) + 2 + (int64_t)(0.01 * NewFrameRate);
+	return commitWindows.Decide(cameraCnt, (int64_t)frameID, (int64_t)lastGrabFrameID, preTriggerFrames, closing);
+}
+
+/*
+=================
+The function CommitFrame writes one image to the binary file of its camera and logs it to the csvFile with its original FrameID and timestamp, and continues in a new segment every segmentFrames frames. The caller holds ghMutex. It is used by the grab threads when recording continuously and by the ring writers with preTriggerSeconds > 0 or image events.
+=================
+*/
+int CommitFrame(CameraSession& session, const char* imageData, const FrameRecord& record)
+{
+	const int cameraCnt = session.cameraCnt;
+
+	// Writing slower than half the frame period signals the background converter to hold back
+	const auto writeBudget = std::chrono::duration<double>(0.5 / NewFrameRate);
+
+	// Do the writing to assigned cameraFile
+	auto writeStart = steady_clock::now();
+	int writeResult = cameraSinks[cameraCnt]->Write(imageData, record.size, record.frameID, record.timestamp);
+	auto writeEnd = steady_clock::now();
+	if (writeEnd - writeStart > writeBudget)
+	{
+		writePressure = true;
+	}
+	if (latencyBenchmark == 1)
+	{
+		session.latency.Add(record, duration_cast<nanoseconds>(writeEnd.time_since_epoch()).count());
+	}
+
+	csvFile << record.frameID << "," << record.timestamp << "," << session.serialNumber << "," << cameraCnt << "," << record.systemTime << "," << record.trial;
+	if (chunkData == 1)
+	{
+		// Chunks the camera does not deliver stay empty
+		const ChunkLayout& chunks = session.chunks;
+		csvFile << ",";
+		if (chunks.exposureTime)
+		{
+			csvFile << record.exposureTime;
+		}
+		csvFile << ",";
+		if (chunks.gain)
+		{
+			csvFile << record.gain;
+		}
+		csvFile << ",";
+		if (chunks.lineStatus)
+		{
+			csvFile << record.lineStatus;
+		}
+	}
+	csvFile << endl;
+
+	// Same record for the merged session index, in the system time of the primary machine
+	if (coordinated)
+	{
+		coordinatorLog += coordinatorPrefix + to_string(record.frameID) + "," + to_string(record.timestamp) + "," + session.serialNumber + ","
+			+ to_string(cameraCnt) + "," + to_string(record.systemTime + clockOffsetNs) + "," + to_string(record.trial) + "\n";
+	}
+	session.lastFrameID.store(record.frameID, memory_order_relaxed);
+	session.framesWritten.fetch_add(1, memory_order_relaxed);
+
+	// Check if the writing is successful
+	if (writeResult != 0)
+	{
+		cout << "Error writing to file for camera " << cameraCnt << " !" << endl;
+		return -1;
+	}
+
+	// Finalize the segment after segmentFrames frames and continue in a new file
+	if (segmentFrames > 0 && ++segmentFrameCnt[cameraCnt] >= segmentFrames)
+	{
+		return RollSegment(cameraCnt);
+	}
+	return 0;
+}
+
+/*
+=================
+The function AllocateFrameRings preallocates the pre-trigger ring of every camera before recording, large enough for preTriggerSeconds plus postTriggerSeconds of frames, so that one event is saved completely even if the disk is slower than the cameras. With image events or real-time grab threads and no pre-trigger the same ring is the frame queue between the grab side and the writer thread and holds as many frames as the stream buffers, bufferSeconds of frames or numBuffers. The functions UsesFrameRings and FrameRingSlots tell PlanCameraMemory which rings will be allocated and how large they are. The function PushFrame copies a grabbed image into the ring, it never blocks and counts the image as overrun if the ring is full.
+=================
+*/
+bool UsesFrameRings()
+{
+	return preTriggerSeconds > 0 || acquisitionMode == "event" || realtimePriority == 1;
+}
+
+uint64_t FrameRingSlots(const CameraSession& session)
+{
+	if (preTriggerSeconds > 0)
+	{
+		return (uint64_t)ceil((preTriggerSeconds + postTriggerSeconds) * session.frameRate) + 1;
+	}
+	if (bufferSeconds > 0)
+	{
+		return (uint64_t)ceil(bufferSeconds * session.frameRate) + 1;
+	}
+	return (uint64_t)max(numBuffers, 1) + 1;
+}
+
+int AllocateFrameRings(vector<CameraSession>& sessions)
+{
+	const bool preTrigger = preTriggerSeconds > 0;
+	cout << endl << (preTrigger ? "*** PRE-TRIGGER RING ***" : "*** FRAME QUEUE ***") << endl << endl;
+
+	double totalMB = 0.0;
+	try
+	{
+		for (CameraSession& session : sessions)
+		{
+			FrameRing& ring = session.ring;
+			ring.slots = FrameRingSlots(session);
+			ring.slotSize = (size_t)session.width * session.height; // 8 bit raw images
+			ring.data.assign(ring.slots * ring.slotSize, 0); // touch all pages before recording
+			ring.records.resize(ring.slots);
+
+			double ringMB = ring.slots * ring.slotSize / (1024.0 * 1024.0);
+			totalMB += ringMB;
+			cout << "Camera [" << session.serialNumber << "] keeps " << ring.slots << " frames, " << ring.slots / session.frameRate << " s (" << ringMB << " MB)" << endl;
+		}
+	}
+	catch (std::bad_alloc&)
+	{
+		cout << "Unable to allocate the frame rings in RAM. Aborting..." << endl;
+		return -1;
+	}
+
+	if (preTrigger)
+	{
+		cout << "Saving " << preTriggerSeconds << " s before and " << postTriggerSeconds << " s after each trigger, " << totalMB << " MB in total" << endl;
+	}
+	else
+	{
+		cout << "Grabbed frames queue for the writer threads, " << totalMB << " MB in total" << endl;
+	}
+	return 0;
+}
+
+bool PushFrame(FrameRing& ring, const char* imageData, const FrameRecord& record)
+{
+	uint64_t head = ring.head.load(memory_order_relaxed);
+	if (head - ring.tail.load(memory_order_acquire) >= ring.slots || record.size > ring.slotSize)
+	{
+		ring.overruns.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+
+	uint64_t slot = head % ring.slots;
+	memcpy(&ring.data[slot * ring.slotSize], imageData, record.size);
+	ring.records[slot] = record;
+	ring.head.store(head + 1, memory_order_release);
+	return true;
+}
+
+/*
+=================
+The function CreatePreview creates the preview shared memory with PREVIEW_SLOTS slots per camera, sized by PreviewDataBytes for the largest downscaled camera image. The function PublishPreview downscales one image with ProxyDownscale straight into the next slot, color images are demosaiced to BGR8 on the way. It takes no lock and never waits for readers.
+=================
+*/
+const uint32_t PREVIEW_SLOTS = 4;
+SharedMemory previewMemory;
+
+uint64_t PreviewDataBytes(vector<CameraSession>& sessions)
+{
+	if (previewScale < 1 || previewScale > 16)
+	{
+		cout << "Warning: previewScale must be between 1 and 16, using 4" << endl;
+		previewScale = 4;
+	}
+
+	uint64_t dataBytes = 0;
+	for (CameraSession& session : sessions)
+	{
+		if (session.bayer && previewScale % 2 != 0)
+		{
+			cout << "Warning: previewScale must be even for color cameras, using " << previewScale + 1 << endl;
+			previewScale++;
+		}
+	}
+	for (CameraSession& session : sessions)
+	{
+		uint64_t channels = session.bayer ? 3 : 1;
+		dataBytes = max(dataBytes, (uint64_t)(session.width / previewScale) * (session.height / previewScale) * channels);
+	}
+	return dataBytes;
+}
+
+int CreatePreview(vector<CameraSession>& sessions)
+{
+	uint64_t dataBytes = PreviewDataBytes(sessions);
+	vector<string> serialNumbers;
+	for (CameraSession& session : sessions)
+	{
+		serialNumbers.push_back(session.serialNumber);
+	}
+
+	uint64_t size = SharedFramesSize((uint32_t)sessions.size(), PREVIEW_SLOTS, dataBytes);
+	if (!CreateSharedMemory(previewMemory, previewName, size))
+	{
+		cout << "Unable to create preview shared memory " << previewName << ". Preview disabled..." << endl;
+		return -1;
+	}
+	InitSharedFrames(previewMemory.base, serialNumbers, PREVIEW_SLOTS, dataBytes);
+
+	cout << "Publishing every " << previewEvery << ". frame at 1/" << previewScale << " size to shared memory " << previewName << " (" << size / 1024 << " kB)" << endl;
+	return 0;
+}
+
+void PublishPreview(CameraSession& session, const char* imageData, const FrameRecord& record)
+{
+	const int channels = session.bayer ? 3 : 1;
+	const int width = session.width / previewScale;
+	const int height = session.height / previewScale;
+	if (record.size < (size_t)session.width * session.height)
+	{
+		return;
+	}
+
+	SharedSlot* slot = BeginSharedFrame(previewMemory.base, session.cameraCnt);
+	slot->width = width;
+	slot->height = height;
+	slot->channels = channels;
+	slot->frameID = record.frameID;
+	slot->timestamp = record.timestamp;
+	slot->size = (uint64_t)width * height * channels;
+	ProxyDownscale(reinterpret_cast<const uint8_t*>(imageData), session.width, session.height, session.bayer, previewScale, SharedPixels(slot), (size_t)width * channels, session.previewScratch);
+	EndSharedFrame(previewMemory.base, session.cameraCnt, slot);
+}
+
+/*
+=================
+The function CreateFanout creates the full-rate shared memory with fanoutSlots raw images per camera, sized by FanoutDataBytes for the largest camera image, and a table for fanoutConsumers consumer processes, e.g. online pose tracking. The function PublishFanout copies one raw image with its FrameID and timestamp into the next slot. It is only called while consumers are attached, by the grab thread after the image is written to disk or by the ring writer as soon as the image is in the ring, consumers that fall behind are dropped by CheckConsumers in the main thread. The function ReportConsumers prints the lag statistics after recording.
+=================
+*/
+SharedMemory fanoutMemory;
+std::atomic<uint32_t> fanoutActive(0); // attached consumers, updated by the main thread
+
+uint64_t FanoutDataBytes(const vector<CameraSession>& sessions)
+{
+	uint64_t dataBytes = 0;
+	for (const CameraSession& session : sessions)
+	{
+		dataBytes = max(dataBytes, (uint64_t)session.width * session.height); // 8 bit raw images
+	}
+	return dataBytes;
+}
+
+int CreateFanout(vector<CameraSession>& sessions)
+{
+	uint64_t dataBytes = FanoutDataBytes(sessions);
+	vector<string> serialNumbers;
+	for (CameraSession& session : sessions)
+	{
+		serialNumbers.push_back(session.serialNumber);
+	}
+
+	uint64_t size = SharedFramesSize((uint32_t)sessions.size(), fanoutSlots, dataBytes, fanoutConsumers);
+	if (!CreateSharedMemory(fanoutMemory, fanoutName, size))
+	{
+		cout << "Unable to create frame shared memory " << fanoutName << ". Frame consumers disabled..." << endl;
+		return -1;
+	}
+	InitSharedFrames(fanoutMemory.base, serialNumbers, fanoutSlots, dataBytes, fanoutConsumers);
+
+	cout << "Sharing all frames with up to " << fanoutConsumers << " consumers in shared memory " << fanoutName << ", " << fanoutSlots
+		<< " frames per camera (" << size / (1024 * 1024) << " MB)" << endl;
+	return 0;
+}
+
+void PublishFanout(CameraSession& session, const char* imageData, const FrameRecord& record)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(fanoutMemory.base);
+	if (record.size > header->dataBytes)
+	{
+		return;
+	}
+
+	SharedSlot* slot = BeginSharedFrame(fanoutMemory.base, session.cameraCnt);
+	slot->width = session.width;
+	slot->height = session.height;
+	slot->channels = 1; // raw Mono8 or BayerRG8 as recorded
+	slot->frameID = record.frameID;
+	slot->timestamp = record.timestamp;
+	slot->size = record.size;
+	memcpy(SharedPixels(slot), imageData, record.size);
+	EndSharedFrame(fanoutMemory.base, session.cameraCnt, slot);
+}
+
+void ReportConsumers()
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(fanoutMemory.base);
+	for (uint32_t consumer = 0; consumer < header->consumers; consumer++)
+	{
+		SharedConsumer* entry = SharedConsumerAt(fanoutMemory.base, consumer);
+		uint64_t frames = entry->frames.load(memory_order_relaxed);
+		if (frames == 0 && entry->state == CONSUMER_FREE)
+		{
+			continue;
+		}
+		cout << "Frame consumer " << consumer << " (process " << entry->processID << ") read " << frames << " frames, at most "
+			<< entry->maxLag << " frames behind" << (entry->state == CONSUMER_DROPPED ? ", dropped for falling behind" : "") << endl;
+	}
+}
+
+/*
+=================
+The function WriteFramesFromRing runs in one thread per camera with preTriggerSeconds > 0, image events or realtimePriority. It passes every frame to the activity gate and the shared memory outputs as soon as it is in the ring, so neither the SDK thread of the image events nor a real-time grab thread spends time on them. It takes frames from the ring in grab order and commits or drops them according to the commit window. It owns the binary files of its camera, opens the files of a new trial with the first committed frame of that trial and closes them once the grab thread has finished.
+=================
+*/
+int WriteFramesFromRing(CameraSession& session)
+{
+	FrameRing& ring = session.ring;
+	const int cameraCnt = session.cameraCnt;
+	const bool gateThisCamera = session.serialNumber == gateCamera;
+	const bool usePreview = previewEvery > 0 && previewMemory.base != nullptr;
+	const bool useFanout = fanoutMemory.base != nullptr;
+	uint64_t published = 0; // frames passed to the gate and the shared memory outputs
+	int fileTrial = 1; // the files created at startup belong to trial 1
+	int threadResult = 1;
+
+	if (!writerCoreList.empty())
+	{
+		PinCurrentThread(writerCoreList, false);
+	}
+
+	while (true)
+	{
+		// closed is read before head, so all images pushed before closing are seen
+		bool closing = ring.closed.load(memory_order_acquire);
+		uint64_t head = ring.head.load(memory_order_acquire);
+
+		// The gate sees the newest frames right away, it opens the commit window for the frames held below
+		for (; published < head; published++)
+		{
+			uint64_t slot = published % ring.slots;
+			const FrameRecord& record = ring.records[slot];
+			const char* imageData = &ring.data[slot * ring.slotSize];
+			if (gateThisCamera && record.size >= ring.slotSize)
+			{
+				UpdateActivityGate(imageData, session.width, session.height, record.frameID);
+			}
+			if (useFanout && fanoutActive.load(memory_order_relaxed) > 0)
+			{
+				PublishFanout(session, imageData, record);
+			}
+			if (usePreview && published % previewEvery == 0)
+			{
+				PublishPreview(session, imageData, record);
+			}
+		}
+
+		uint64_t tail = ring.tail.load(memory_order_relaxed);
+		if (tail == head)
+		{
+			if (closing)
+			{
+				break;
+			}
+			this_thread::sleep_for(milliseconds(1));
+			continue;
+		}
+
+		uint64_t slot = tail % ring.slots;
+		const FrameRecord& record = ring.records[slot];
+		commitDecision decision = DecideCommit(cameraCnt, record.frameID, session.lastGrabFrameID.load(memory_order_relaxed), closing);
+		if (decision == HOLD)
+		{
+			this_thread::sleep_for(milliseconds(1));
+			continue;
+		}
+
+		// After a write error the ring is still drained so that the grab thread keeps running
+		if (decision == COMMIT && threadResult == 1)
+		{
+			if (record.trial != fileTrial)
+			{
+				fileTrial = record.trial;
+				if (RollTrial(cameraCnt, session.serialNumber, fileTrial) != 0)
+				{
+					threadResult = 0;
+				}
+			}
+
+			ghMutex.lock();
+			if (threadResult == 1 && CommitFrame(session, &ring.data[slot * ring.slotSize], record) != 0)
+			{
+				threadResult = 0;
+			}
+			ghMutex.unlock();
+			ring.committed += threadResult;
+		}
+		else
+		{
+			ring.dropped++;
+		}
+		ring.tail.store(tail + 1, memory_order_release);
+	}
+	commitWindows.Leave(cameraCnt);
+
+	if (segmentFrames > 0)
+	{
+		FinishSegment(cameraCnt);
+	}
+	else
+	{
+		cameraSinks[cameraCnt]->Close();
+	}
+
+	if (preTriggerSeconds > 0)
+	{
+		cout << "Camera [" << session.serialNumber << "] saved " << ring.committed << " frames around triggers, dropped " << ring.dropped << " frames" << endl;
+	}
+	if (ring.overruns > 0)
+	{
+		cout << "Warning: camera [" << session.serialNumber << "] lost " << ring.overruns << " frames because the frame ring was full!" << endl;
+	}
+	return threadResult;
+}
+
+/*
+=================
+The function ConfigureCamera initializes one camera session and sets DeviceUserID, Trigger, Buffer, Strobe, Exposure, Image Settings and Chunk Data. It is started in parallel threads by InitializeMultipleCameras.
+=================
+*/
+void ConfigureCamera(CameraSession& config)
+{
+	ostream& out = config.log;
+	auto configStart = steady_clock::now();
+
+	try
+	{
+		CameraPtr pCam = config.pCam;
+		pCam->Init();
+
+		INodeMap& nodeMap = pCam->GetNodeMap();
+		CStringPtr ptrStringSerial = pCam->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
+
+		if (IsAvailable(ptrStringSerial) && IsReadable(ptrStringSerial))
+		{
+			config.serialNumber = ptrStringSerial->GetValue();
+		}
+
+		// Set DeviceUserID to loop counter to assign camera order to cameraSinks in oarallel threads
+		CStringPtr ptrDeviceUserId = nodeMap.GetNode("DeviceUserID");
+		if (!IsAvailable(ptrDeviceUserId) || !IsWritable(ptrDeviceUserId))
+		{
+			out << "Unable to get node ptrDeviceUserId. Aborting..." << endl << endl;
+			config.result = -1;
+			return;
+		}
+
+		string DeviceUserID = to_string(config.cameraCnt);
+		ptrDeviceUserId->SetValue(DeviceUserID.c_str());
+
+		out << endl << endl << "[" << config.serialNumber << "] " << "*** Camera Initialization ***" << " ID: [" << DeviceUserID << "]" << endl;
+
+		config.primary = (config.serialNumber == triggerCam); // primary camera defined in PARAMETERS
+		if (config.primary)
+		{
+			config.result |= ConfigureStrobe(pCam, nodeMap, out);
+			config.result |= ConfigureTrigger(nodeMap, SOFTWARE, out); // primary camera will work in free running
+		}
+		else // secondary cameras
+		{
+			config.result |= ConfigureTrigger(nodeMap, HARDWARE, out); // secondary cameras are triggered by primary camera
+		}
+
+		// Set Strobe
+		config.result |= ConfigureStrobe(pCam, nodeMap, out);
+
+		// Set Exposure and Framerate
+		config.result |= ConfigureExposure(nodeMap, config.frameRate, out);
+
+		// Set Image Settings
+		config.result |= ImageSettings(nodeMap, config.width, config.height, out);
+
+		// Per-frame metadata appended to the images
+		if (chunkData == 1)
+		{
+			config.result |= ConfigureChunkData(nodeMap, config.chunks, out);
+		}
+
+		// Set Buffer, after the image size is known
+		config.result |= BufferHandlingSettings(pCam, out);
+
+		// Color cameras deliver Bayer raw images, the preview demosaics them
+		CEnumerationPtr ptrPixelFormat = nodeMap.GetNode("PixelFormat");
+		if (IsAvailable(ptrPixelFormat) && IsReadable(ptrPixelFormat))
+		{
+			string pixelFormat = ptrPixelFormat->GetCurrentEntry()->GetSymbolic().c_str();
+			config.bayer = pixelFormat.rfind("Bayer", 0) == 0;
+			out << "Pixel format " << pixelFormat << endl;
+		}
+
+		// The camera stays initialized for recording
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		out << "Error: " << e.what() << endl;
+		config.result = -1;
+	}
+
+	config.seconds = duration<double>(steady_clock::now() - configStart).count();
+}
+
+/*
+=================
+The function InitializeMultipleCameras bundles the initialization process for all cameras on the system. It is called in RecordMultipleCameraThreads and configures all cameras in parallel threads with ConfigureCamera. After all threads are done, their output is printed camera by camera followed by a summary table.
+=================
+*/
+int InitializeMultipleCameras(CameraList camList, vector<CameraSession>& configs)
+{
+	int result = 0;
+	unsigned int camListSize = (unsigned int)configs.size();
+	auto initStart = steady_clock::now();
+
+	// Create .csv logfile and .txt metadata once for all cameras
+	CreateSessionFiles(camListSize);
+
+	vector<thread> configThreads;
+
+	for (unsigned int i = 0; i < camListSize; i++)
+	{
+		// Select camera in loop
+		configs[i].pCam = camList.GetByIndex(i); // TODO: try to get order USB Interface/primary vs secondary // get serial
+		configs[i].cameraCnt = i;
+
+		configThreads.emplace_back(ConfigureCamera, std::ref(configs[i]));
+	}
+
+	// Barrier: all cameras are configured before recording starts
+	for (unsigned int i = 0; i < camListSize; i++)
+	{
+		configThreads[i].join();
+		cout << configs[i].log.str();
+	}
+
+	// Summary of all cameras
+	cout << endl << "*** CAMERA CONFIGURATION ***" << endl << endl;
+	cout << "ID\tSerial\t\tRole\t\tFPS\tWidth x Height\tTime [s]\tResult" << endl;
+	for (unsigned int i = 0; i < camListSize; i++)
+	{
+		CameraSession& config = configs[i];
+		cout << config.cameraCnt << "\t" << config.serialNumber << "\t" << (config.primary ? "primary  " : "secondary") << "\t"
+			<< config.frameRate << "\t" << config.width << " x " << config.height << "\t" << config.seconds << "\t"
+			<< (config.result == 0 ? "OK" : "FAILED") << endl;
+
+		if (config.result != 0)
+		{
+			result = -1;
+		}
+
+		// Recording settings are taken from the primary camera
+		if (config.primary || i == 0)
+		{
+			NewFrameRate = config.frameRate;
+			widthToSet = config.width;
+			heightToSet = config.height;
+		}
+	}
+	cout << endl << "Cameras configured in " << duration<double>(steady_clock::now() - initStart).count() << " seconds" << endl;
+
+	return result;
+}
+
+/*
+=================
+The function FreeMemoryMB returns the physical memory that is currently available in MB.
+=================
+*/
+double FreeMemoryMB()
+{
+#if defined(_WIN32)
+	MEMORYSTATUSEX memoryStatus;
+	memoryStatus.dwLength = sizeof(memoryStatus);
+	if (!GlobalMemoryStatusEx(&memoryStatus))
+	{
+		return 0;
+	}
+	return memoryStatus.ullAvailPhys / (1024.0 * 1024.0);
+#else
+	return (double)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#endif
+}
+
+/*
+=================
+The function PlanCameraMemory plans all RAM the cameras take during recording in one place, before any of it is allocated: the frame rings of AllocateFrameRings, the preview and fanout shared memory and the stream buffers. Rings and shared memory have a fixed size, the stream buffers get what is left of bufferRamBudgetMB. Each camera gets bufferSeconds of frames, if all cameras together need more than is left, every count is reduced by the same factor, so all cameras keep the same headroom in seconds. No camera gets less than MIN_STREAM_BUFFERS, a warning tells if this minimum or the fixed memory override the budget. With bufferSeconds 0 the numBuffers of BufferHandlingSettings are counted as they are. The planned memory is reported before the buffers are allocated with BeginAcquisition.
+=================
+*/
+const int64_t MIN_STREAM_BUFFERS = 10;
+
+int PlanCameraMemory(vector<CameraSession>& sessions)
+{
+	cout << endl << "*** PLANNING CAMERA MEMORY ***" << endl << endl;
+
+	const double MB = 1024.0 * 1024.0;
+	double budgetMB = bufferRamBudgetMB > 0 ? bufferRamBudgetMB : FreeMemoryMB() / 2;
+
+	// Fixed memory, the frame rings of every camera and the shared memory of preview and fanout
+	vector<double> ringMB(sessions.size(), 0.0);
+	double ringsMB = 0;
+	if (UsesFrameRings())
+	{
+		for (size_t i = 0; i < sessions.size(); i++)
+		{
+			ringMB[i] = FrameRingSlots(sessions[i]) * (double)sessions[i].width * sessions[i].height / MB; // 8 bit raw images
+			ringsMB += ringMB[i];
+		}
+	}
+	double sharedMB = 0;
+	if (previewEvery > 0)
+	{
+		sharedMB += SharedFramesSize((uint32_t)sessions.size(), PREVIEW_SLOTS, PreviewDataBytes(sessions)) / MB;
+	}
+	if (fanoutSlots > 0)
+	{
+		sharedMB += SharedFramesSize((uint32_t)sessions.size(), fanoutSlots, FanoutDataBytes(sessions), fanoutConsumers) / MB;
+	}
+	double streamBudgetMB = budgetMB - ringsMB - sharedMB;
+	if (streamBudgetMB <= 0)
+	{
+		cout << "Warning: frame rings and shared memory need " << ringsMB + sharedMB << " MB, more than the budget of " << budgetMB << " MB!" << endl;
+		streamBudgetMB = 0;
+	}
+
+	// Buffer size of each camera, PayloadSize includes chunk data and padding
+	vector<double> payloads(sessions.size());
+	double requiredMB = 0;
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		payloads[i] = (double)sessions[i].width * sessions[i].height;
+		try
+		{
+			CIntegerPtr ptrPayloadSize = sessions[i].pCam->GetNodeMap().GetNode("PayloadSize");
+			if (IsAvailable(ptrPayloadSize) && IsReadable(ptrPayloadSize))
+			{
+				payloads[i] = (double)ptrPayloadSize->GetValue();
+			}
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "[" << sessions[i].serialNumber << "] Error: " << e.what() << endl;
+		}
+		requiredMB += ceil(bufferSeconds * sessions[i].frameRate) * payloads[i] / MB;
+	}
+
+	double scale = 1.0;
+	if (bufferSeconds > 0 && requiredMB > streamBudgetMB)
+	{
+		scale = streamBudgetMB / requiredMB;
+		cout << "Warning: " << bufferSeconds << " seconds of buffers need " << requiredMB << " MB, reduced to the " << streamBudgetMB << " MB left of the budget!" << endl;
+	}
+
+	int result = 0;
+	int minimumCameras = 0;
+	double plannedMB = 0;
+	cout << "Serial		Frame [MB]	Buffers	Seconds	Memory [MB]	Ring [MB]" << endl;
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		int64_t bufferCount = numBuffers;
+		if (bufferSeconds > 0)
+		{
+			int64_t scaledCount = (int64_t)(ceil(bufferSeconds * sessions[i].frameRate) * scale);
+			if (scaledCount < MIN_STREAM_BUFFERS)
+			{
+				minimumCameras++;
+			}
+			bufferCount = max<int64_t>(scaledCount, MIN_STREAM_BUFFERS);
+			try
+			{
+				CIntegerPtr ptrBufferCount = sessions[i].pCam->GetTLStreamNodeMap().GetNode("StreamBufferCountManual");
+				if (!IsAvailable(ptrBufferCount) || !IsWritable(ptrBufferCount))
+				{
+					cout << "Unable to set Buffer Count of camera [" << sessions[i].serialNumber << "]. Aborting..." << endl;
+					result = -1;
+					continue;
+				}
+				bufferCount = min<int64_t>(bufferCount, ptrBufferCount->GetMax());
+				ptrBufferCount->SetValue(bufferCount);
+			}
+			catch (Spinnaker::Exception& e)
+			{
+				cout << "[" << sessions[i].serialNumber << "] Error: " << e.what() << endl;
+				result = -1;
+				continue;
+			}
+		}
+
+		double cameraMB = bufferCount * payloads[i] / MB;
+		plannedMB += cameraMB;
+		cout << sessions[i].serialNumber << "\t" << payloads[i] / MB << "\t\t" << bufferCount << "\t" << bufferCount / sessions[i].frameRate << "\t" << cameraMB << "\t\t" << ringMB[i] << endl;
+	}
+
+	double totalMB = plannedMB + ringsMB + sharedMB;
+	cout << "Stream buffers " << plannedMB << " MB, frame rings " << ringsMB << " MB, shared memory " << sharedMB << " MB" << endl;
+	cout << "Cameras commit " << totalMB << " MB of " << budgetMB << " MB budget" << endl;
+	if (totalMB > budgetMB)
+	{
+		if (minimumCameras > 0)
+		{
+			cout << "Warning: " << minimumCameras << " cameras keep the minimum of " << MIN_STREAM_BUFFERS << " stream buffers, the plan exceeds the budget by " << totalMB - budgetMB << " MB!" << endl;
+		}
+		else
+		{
+			cout << "Warning: the plan exceeds the budget by " << totalMB - budgetMB << " MB!" << endl;
+		}
+	}
+	return result;
+}
+
+/*
+=================
+The function ReadCameraInterfaces finds the host controller of every camera. Spinnaker lists one interface per USB3 host controller, cameras on the same interface share its bandwidth. It is called in main, where the system object is available.
+=================
+*/
+map<string, string> cameraInterfaces; // serial number -> interface
+
+void ReadCameraInterfaces(SystemPtr system)
+{
+	InterfaceList interfaceList = system->GetInterfaces();
+	for (unsigned int i = 0; i < interfaceList.GetSize(); i++)
+	{
+		InterfacePtr pInterface = interfaceList.GetByIndex(i);
+		string interfaceName = "interface" + to_string(i);
+		CStringPtr ptrInterfaceID = pInterface->GetTLNodeMap().GetNode("InterfaceID");
+		if (IsAvailable(ptrInterfaceID) && IsReadable(ptrInterfaceID))
+		{
+			interfaceName = ptrInterfaceID->GetValue().c_str();
+		}
+
+		CameraList interfaceCameras = pInterface->GetCameras();
+		for (unsigned int c = 0; c < interfaceCameras.GetSize(); c++)
+		{
+			CStringPtr ptrSerial = interfaceCameras.GetByIndex(c)->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
+			if (IsAvailable(ptrSerial) && IsReadable(ptrSerial))
+			{
+				cameraInterfaces[ptrSerial->GetValue().c_str()] = interfaceName;
+			}
+		}
+		interfaceCameras.Clear();
+	}
+	interfaceList.Clear();
+}
+
+/*
+=================
+The function PlanCameraBandwidth runs the bandwidth planner of BandwidthPlan.h on the configured cameras. It reads pixel size, link speed and current throughput of each camera, prints the plan and sets DeviceLinkThroughputLimit, so that no camera takes the bandwidth its neighbours on the same host controller need. It returns -1 if the plan is infeasible and bandwidthStrict is set.
+=================
+*/
+int PlanCameraBandwidth(vector<CameraSession>& sessions)
+{
+	cout << endl << "*** PLANNING USB BANDWIDTH ***" << endl << endl;
+
+	vector<BandwidthCamera> cameras(sessions.size());
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		CameraSession& session = sessions[i];
+		BandwidthCamera& camera = cameras[i];
+		camera.serial = session.serialNumber;
+		camera.controller = cameraInterfaces.count(session.serialNumber) ? cameraInterfaces[session.serialNumber] : "unknown";
+
+		try
+		{
+			INodeMap& nodeMap = session.pCam->GetNodeMap();
+
+			// PixelSize reads Bpp8, Bpp12, Bpp16, ...
+			int bitsPerPixel = 8;
+			CEnumerationPtr ptrPixelSize = nodeMap.GetNode("PixelSize");
+			if (IsAvailable(ptrPixelSize) && IsReadable(ptrPixelSize))
+			{
+				string pixelSize = ptrPixelSize->GetCurrentEntry()->GetSymbolic().c_str();
+				bitsPerPixel = stoi(pixelSize.substr(3));
+			}
+			camera.required = RequiredBandwidth(session.width, session.height, bitsPerPixel, session.frameRate);
+
+			CIntegerPtr ptrLinkSpeed = nodeMap.GetNode("DeviceLinkSpeed");
+			CIntegerPtr ptrCurrentThroughput = nodeMap.GetNode("DeviceLinkCurrentThroughput");
+			if (IsAvailable(ptrLinkSpeed) && IsReadable(ptrLinkSpeed))
+			{
+				cout << "[" << camera.serial << "] link speed " << ptrLinkSpeed->GetValue() / (1024 * 1024) << " MB/s";
+				if (IsAvailable(ptrCurrentThroughput) && IsReadable(ptrCurrentThroughput))
+				{
+					cout << ", current throughput " << ptrCurrentThroughput->GetValue() / (1024 * 1024) << " MB/s";
+				}
+				cout << endl;
+			}
+
+			CIntegerPtr ptrThroughputLimit = nodeMap.GetNode("DeviceLinkThroughputLimit");
+			if (IsAvailable(ptrThroughputLimit) && IsReadable(ptrThroughputLimit))
+			{
+				camera.limitMin = (double)ptrThroughputLimit->GetMin();
+				camera.limitMax = (double)ptrThroughputLimit->GetMax();
+			}
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "[" << camera.serial << "] Error: " << e.what() << endl;
+		}
+	}
+
+	vector<BandwidthController> controllers;
+	int result = PlanBandwidth(cameras, controllerBandwidth * 1024 * 1024, bandwidthHeadroom / 100.0, controllers);
+	cout << endl;
+	ReportBandwidthPlan(cameras, controllers, controllerBandwidth * 1024 * 1024, cout);
+
+	// Apply the limits, the resulting frame rate shows whether the camera still keeps up
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		try
+		{
+			INodeMap& nodeMap = sessions[i].pCam->GetNodeMap();
+			CEnumerationPtr ptrLimitMode = nodeMap.GetNode("DeviceLinkThroughputLimitMode");
+			if (IsAvailable(ptrLimitMode) && IsWritable(ptrLimitMode))
+			{
+				CEnumEntryPtr ptrLimitModeOn = ptrLimitMode->GetEntryByName("On");
+				if (IsAvailable(ptrLimitModeOn) && IsReadable(ptrLimitModeOn))
+				{
+					ptrLimitMode->SetIntValue(ptrLimitModeOn->GetValue());
+				}
+			}
+
+			CIntegerPtr ptrThroughputLimit = nodeMap.GetNode("DeviceLinkThroughputLimit");
+			if (!IsAvailable(ptrThroughputLimit) || !IsWritable(ptrThroughputLimit))
+			{
+				cout << "Warning: DeviceLinkThroughputLimit of camera [" << sessions[i].serialNumber << "] is not writable!" << endl;
+				continue;
+			}
+			int64_t increment = max<int64_t>(ptrThroughputLimit->GetInc(), 1);
+			int64_t limit = ptrThroughputLimit->GetMin() + ((int64_t)cameras[i].limit - ptrThroughputLimit->GetMin()) / increment * increment;
+			ptrThroughputLimit->SetValue(limit);
+
+			CFloatPtr ptrResultingFrameRate = nodeMap.GetNode("AcquisitionResultingFrameRate");
+			if (IsAvailable(ptrResultingFrameRate) && IsReadable(ptrResultingFrameRate) && ptrResultingFrameRate->GetValue() < sessions[i].frameRate - 0.01)
+			{
+				cout << "Warning: camera [" << sessions[i].serialNumber << "] reaches only " << ptrResultingFrameRate->GetValue() << " of " << sessions[i].frameRate << " FPS with its throughput limit!" << endl;
+				result = -1;
+			}
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "[" << sessions[i].serialNumber << "] Error: " << e.what() << endl;
+		}
+	}
+
+	if (result != 0)
+	{
+		if (bandwidthStrict == 1)
+		{
+			cout << endl << "The cameras need more USB bandwidth than available, reduce FPS, image size or cameras per host controller. Aborting..." << endl;
+			return -1;
+		}
+		cout << endl << "Warning: the cameras need more USB bandwidth than available, frames may be lost!" << endl;
+	}
+	return 0;
+}
+
+/*
+=================
+The function MeasureVolume runs the pre-flight storage benchmark on one recording volume. It writes one stream per camera through the same FrameSink backend as the recording, one image per write and each write under ghMutex as in CommitFrame, for preflightSeconds. Local files are flushed to the disk before the time is taken, so the file cache can not hide a slow disk. It returns the sustained write rate in bytes per second, or -1 if the volume can not be written. The benchmark files are deleted afterwards, TCPtoBIN keeps its copies.
+=================
+*/
+struct PreflightStream
+{
+	int cameraCnt = 0;
+	size_t imageSize = 0;
+	string filename;
+	uint64_t bytes = 0;
+	double seconds = 0;
+	int result = 0;
+};
+
+void FlushToDisk(const string& filename)
+{
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		FlushFileBuffers(file);
+		CloseHandle(file);
+	}
+#else
+	int file = open(filename.c_str(), O_WRONLY);
+	if (file >= 0)
+	{
+		fsync(file);
+		close(file);
+	}
+#endif
+}
+
+void WritePreflightStream(PreflightStream& stream)
+{
+	unique_ptr<FrameSink> sink = CreateSink(stream.cameraCnt);
+
+	// Image content that file systems can not compress
+	vector<char> image(stream.imageSize);
+	for (size_t i = 0; i < image.size(); i++)
+	{
+		image[i] = (char)((i * 2654435761u) >> 24);
+	}
+
+	if (sink->Open(stream.filename) != 0)
+	{
+		stream.result = -1;
+		return;
+	}
+
+	auto streamStart = steady_clock::now();
+	const auto streamDuration = std::chrono::duration<double>(preflightSeconds);
+	uint64_t frameID = 0;
+	while (steady_clock::now() - streamStart < streamDuration)
+	{
+		ghMutex.lock();
+		int writeResult = sink->Write(image.data(), image.size(), frameID++, 0);
+		ghMutex.unlock();
+		if (writeResult != 0)
+		{
+			stream.result = -1;
+			break;
+		}
+		stream.bytes += image.size();
+	}
+
+	sink->Close();
+	if (sinkHost.empty())
+	{
+		FlushToDisk(stream.filename);
+	}
+	stream.seconds = duration<double>(steady_clock::now() - streamStart).count();
+}
+
+double MeasureVolume(vector<CameraSession>& sessions, string volume)
+{
+	unsigned int numStreams = (unsigned int)sessions.size();
+	vector<PreflightStream> streams(numStreams);
+	for (unsigned int i = 0; i < numStreams; i++)
+	{
+		streams[i].cameraCnt = sessions[i].cameraCnt;
+		streams[i].imageSize = (size_t)sessions[i].width * sessions[i].height;
+		streams[i].filename = volume + "preflight_" + sessions[i].serialNumber + ".tmp";
+	}
+
+	vector<thread> streamThreads;
+	for (unsigned int i = 0; i < numStreams; i++)
+	{
+		streamThreads.emplace_back(WritePreflightStream, std::ref(streams[i]));
+	}
+	for (thread& streamThread : streamThreads)
+	{
+		streamThread.join();
+	}
+
+	uint64_t bytes = 0;
+	double seconds = 0;
+	int result = 0;
+	for (unsigned int i = 0; i < numStreams; i++)
+	{
+		bytes += streams[i].bytes;
+		seconds = max(seconds, streams[i].seconds);
+		result |= streams[i].result;
+		if (sinkHost.empty())
+		{
+			remove(streams[i].filename.c_str());
+		}
+	}
+
+	if (result != 0)
+	{
+		return -1;
+	}
+	return (seconds > 0) ? bytes / seconds : 0;
+}
+
+/*
+=================
+The function PlanVolumes assigns every camera to one of the recording volumes in path and checks that the storage keeps up. With preflightSeconds set, each volume is measured with MeasureVolume, otherwise all volumes count as equally fast. Cameras are assigned from the highest data rate down, each to the volume that ends up with the lowest load relative to its measured rate. With stripeSegments the segments of every camera rotate through all volumes, starting at the assigned one, so the load is spread evenly. The margin of a volume is its measured rate over its load, below preflightMargin recording is refused.
+=================
+*/
+int PlanVolumes(vector<CameraSession>& sessions)
+{
+	cout << endl << "*** PLANNING STORAGE ***" << endl << endl;
+
+	const double MB = 1024.0 * 1024.0;
+	size_t numVolumes = sinkHost.empty() ? max<size_t>(volumes.size(), 1) : 1;
+	if (volumes.empty())
+	{
+		volumes.push_back(path);
+	}
+	if (!sinkHost.empty() && volumes.size() > 1)
+	{
+		cout << "Warning: files are streamed to " << sinkHost << ", only one volume is used!" << endl;
+	}
+	bool striped = stripeSegments == 1 && segmentFrames > 0 && numVolumes > 1;
+	if (stripeSegments == 1 && !striped)
+	{
+		cout << "Warning: stripeSegments needs segmentFrames > 0 and several volumes in path, segments are not striped!" << endl;
+		stripeSegments = 0;
+	}
+
+	// Data rate of each camera
+	double requiredRate = 0;
+	vector<double> cameraRates(sessions.size());
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		cameraRates[i] = (double)sessions[i].width * sessions[i].height * sessions[i].frameRate;
+		requiredRate += cameraRates[i];
+	}
+	cout << "Session writes " << requiredRate / MB << " MB/s in " << sessions.size() << " streams" << endl;
+
+	// Sustained write rate of each volume
+	vector<double> volumeRates(numVolumes, 0);
+	for (size_t v = 0; v < numVolumes && preflightSeconds > 0; v++)
+	{
+		string target = sinkHost.empty() ? (volumes[v].empty() ? "current directory" : volumes[v]) : sinkHost + ":" + to_string(sinkPort);
+		cout << "Testing " << target << " for " << preflightSeconds << " seconds..." << endl;
+		volumeRates[v] = MeasureVolume(sessions, volumes[v]);
+		if (volumeRates[v] < 0)
+		{
+			cout << "Unable to write benchmark files to " << target << ". Aborting..." << endl;
+			return -1;
+		}
+	}
+
+	// Fastest cameras first, each to the volume with the lowest relative load afterwards
+	vector<size_t> order(sessions.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cameraRates[a] > cameraRates[b]; });
+
+	vector<double> volumeLoads(numVolumes, 0);
+	for (size_t i : order)
+	{
+		size_t best = 0;
+		double bestLoad = 0;
+		for (size_t v = 0; v < numVolumes; v++)
+		{
+			double load = (volumeLoads[v] + cameraRates[i]) / (volumeRates[v] > 0 ? volumeRates[v] : 1.0);
+			if (v == 0 || load < bestLoad)
+			{
+				best = v;
+				bestLoad = load;
+			}
+		}
+		volumeLoads[best] += cameraRates[i];
+		cameraVolumes[sessions[i].cameraCnt] = (int)best;
+	}
+	if (striped)
+	{
+		fill(volumeLoads.begin(), volumeLoads.end(), requiredRate / numVolumes);
+	}
+
+	int result = 0;
+	for (size_t v = 0; v < numVolumes; v++)
+	{
+		cout << "Volume " << (volumes[v].empty() ? "." : volumes[v]) << ": cameras";
+		for (CameraSession& session : sessions)
+		{
+			if (cameraVolumes[session.cameraCnt] == (int)v)
+			{
+				cout << " " << session.serialNumber;
+			}
+		}
+		cout << (striped ? " (first segment)" : "") << ", " << volumeLoads[v] / MB << " MB/s";
+		if (volumeRates[v] > 0)
+		{
+			double margin = (volumeLoads[v] > 0) ? volumeRates[v] / volumeLoads[v] : 0;
+			cout << ", sustained " << volumeRates[v] / MB << " MB/s, margin " << margin << " (" << preflightMargin << " required)";
+			if (volumeLoads[v] > 0 && margin < preflightMargin)
+			{
+				result = -1;
+			}
+		}
+		cout << endl;
+	}
+
+	if (result != 0)
+	{
+		cout << "Storage can not keep up with the recording, use faster or more disks or reduce FPS, image size or cameras. Aborting..." << endl;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+=================
+The function PurgeStream drains all images queued in the stream buffer of an armed camera. Each GetNextImage waits at most purgeTimeout milliseconds, so the purge ends shortly after the last stale image instead of waiting for numBuffers new images.
+=================
+*/
+int PurgeStream(CameraPtr pCam)
+{
+	int purged = 0;
+	while (true)
+	{
+		try
+		{
+			ImagePtr pStaleImage = pCam->GetNextImage(purgeTimeout);
+			pStaleImage->Release();
+			purged++;
+		}
+		catch (Spinnaker::Exception&)
+		{
+			// timeout, stream buffer is empty
+			break;
+		}
+	}
+	return purged;
+}
+
+/*
+=================
+The function SetTriggerMode switches TriggerMode of a camera On or Off. The function StartPrimaryTrigger turns trigger mode off on the primary camera, which then runs free and triggers all secondary cameras with its strobe. Frame 0 is therefore the same exposure on every camera.
+=================
+*/
+int SetTriggerMode(INodeMap& nodeMap, const char* mode)
+{
+	CEnumerationPtr ptrTriggerMode = nodeMap.GetNode("TriggerMode");
+	if (!IsAvailable(ptrTriggerMode) || !IsWritable(ptrTriggerMode))
+	{
+		cout << "Unable to set trigger mode (node retrieval). Aborting..." << endl;
+		return -1;
+	}
+
+	CEnumEntryPtr ptrTriggerModeEntry = ptrTriggerMode->GetEntryByName(mode);
+	if (!IsAvailable(ptrTriggerModeEntry) || !IsReadable(ptrTriggerModeEntry))
+	{
+		cout << "Unable to set trigger mode (enum entry retrieval). Aborting..." << endl;
+		return -1;
+	}
+	ptrTriggerMode->SetIntValue(ptrTriggerModeEntry->GetValue());
+	return 0;
+}
+
+int StartPrimaryTrigger(vector<CameraSession>& sessions)
+{
+	int result = 0;
+	for (CameraSession& session : sessions)
+	{
+		if (session.primary && session.armed)
+		{
+			try
+			{
+				result = SetTriggerMode(session.pCam->GetNodeMap(), "Off");
+				cout << "Primary camera [" << session.serialNumber << "] started triggering" << endl;
+			}
+			catch (Spinnaker::Exception& e)
+			{
+				cout << "Error: " << e.what() << endl;
+				result = -1;
+			}
+		}
+	}
+	return result;
+}
+
+int HoldPrimaryTrigger(vector<CameraSession>& sessions)
+{
+	int result = 0;
+	for (CameraSession& session : sessions)
+	{
+		if (session.primary && session.armed)
+		{
+			try
+			{
+				result = SetTriggerMode(session.pCam->GetNodeMap(), "On");
+				cout << "Primary camera [" << session.serialNumber << "] stopped triggering" << endl;
+			}
+			catch (Spinnaker::Exception& e)
+			{
+				cout << "Error: " << e.what() << endl;
+				result = -1;
+			}
+		}
+	}
+	return result;
+}
+
+/*
+=================
+The function DrainGrabbedFrames waits after HoldPrimaryTrigger until every grab thread has fetched the last images of the stopped trial from its stream buffer, i.e. no camera grabbed an image for 5 frame periods but at least 50 ms. Only then may currentTrial change, otherwise these images would be written to the files of the next trial. It gives up after 2 s and returns -1.
+=================
+*/
+int DrainGrabbedFrames(vector<CameraSession>& sessions)
+{
+	const int64_t quietNs = max((int64_t)(5e9 / NewFrameRate), (int64_t)50000000);
+	const int64_t drainStart = HostTimeNs();
+	while (true)
+	{
+		int64_t lastGrab = 0;
+		for (CameraSession& session : sessions)
+		{
+			if (session.armed)
+			{
+				lastGrab = max(lastGrab, session.lastGrabNs.load(memory_order_relaxed));
+			}
+		}
+		int64_t now = HostTimeNs();
+		if (now - max(lastGrab, drainStart) >= quietNs)
+		{
+			return 0;
+		}
+		if (now - drainStart > 2000000000)
+		{
+			cout << "Warning: cameras still deliver images after the primary camera was held!" << endl;
+			return -1;
+		}
+		this_thread::sleep_for(milliseconds(1));
+	}
+}
+
+/*
+=================
+The function WaitForRollover waits after currentTrial changed until every grab thread has taken over the new trial, i.e. opened its files or handed the trial to its ring writer. It gives up after 2 s or when a grab thread has already finished, then the new trial must not be started and it returns -1.
+=================
+*/
+int WaitForRollover(vector<CameraSession>& sessions)
+{
+	const int64_t rollStart = HostTimeNs();
+	for (CameraSession& session : sessions)
+	{
+		while (session.trial != currentTrial)
+		{
+			if (session.grabFinished || !session.armed)
+			{
+				cout << "Camera [" << session.serialNumber << "] stopped recording before trial " << currentTrial << "!" << endl;
+				return -1;
+			}
+			if (HostTimeNs() - rollStart > 2000000000)
+			{
+				cout << "Camera [" << session.serialNumber << "] did not open trial " << currentTrial << " within 2 s!" << endl;
+				return -1;
+			}
+			this_thread::sleep_for(milliseconds(1));
+		}
+	}
+	return 0;
+}
+
+/*
+=================
+The function WriteMarker appends one event marker to the events file. Each row holds the marker text, the current trial, the system time in nanoseconds and the last FrameID written by each camera, so that markers can be placed on the recorded frames.
+=================
+*/
+void WriteMarker(string text, vector<CameraSession>& sessions)
+{
+	if (!eventsFile.is_open())
+	{
+		eventsFile.open(eventsFilename);
+		eventsFile << "Marker" << "," << "Trial" << "," << "SystemTimeInNanoseconds";
+		for (CameraSession& session : sessions)
+		{
+			eventsFile << "," << "FrameID_" << session.serialNumber;
+		}
+		eventsFile << endl;
+	}
+
+	// commas would break the csv columns
+	replace(text.begin(), text.end(), ',', ';');
+
+	eventsFile << text << "," << currentTrial << "," << getTimeStamp();
+	for (CameraSession& session : sessions)
+	{
+		eventsFile << "," << session.lastFrameID.load(memory_order_relaxed);
+	}
+	eventsFile << endl;
+}
+
+/*
+=================
+The function ExecuteCommand runs one command from the console or the control channel and writes a one line answer starting with OK or ERR to reply. start begins the next trial, stop holds the primary camera so all cameras stop together, next stops the running trial and starts a new one, quit ends the session. Before a new trial starts, all grab threads have drained the images of the old trial and rolled over to new files. Without sessionMode, stop and quit end the recording. status reports the trial and the frames written per camera, marker <text> saves an event marker. The function HandleCommand locks ExecuteCommand, so commands from the console and the control channel never overlap. It returns false once the recording ends.
+=================
+*/
+bool ExecuteCommand(string command, vector<CameraSession>& sessions, string& reply)
+{
+	// split into command word and argument
+	string argument;
+	size_t space = command.find(' ');
+	if (space != string::npos)
+	{
+		argument = command.substr(space + 1);
+		command = command.substr(0, space);
+	}
+
+	if (command == "status")
+	{
+		stringstream status;
+		status << "OK trial=" << currentTrial << " running=" << trialRunning << " frames=";
+		for (size_t i = 0; i < sessions.size(); i++)
+		{
+			status << (i > 0 ? "," : "") << sessions[i].framesWritten.load(memory_order_relaxed);
+		}
+		reply = status.str();
+	}
+	else if (command == "marker")
+	{
+		WriteMarker(argument, sessions);
+		cout << "Marker " << argument << " saved" << endl;
+		reply = "OK marker";
+	}
+	else if (command == "trigger")
+	{
+		if (preTriggerSeconds <= 0)
+		{
+			reply = "ERR trigger requires preTriggerSeconds > 0";
+			return true;
+		}
+		OpenCommitWindow(FrameAtHostTime(sessions, HostTimeNs()));
+		WriteMarker(argument.empty() ? "trigger" : "trigger " + argument, sessions);
+		cout << "Trigger event, saving frames from " << preTriggerSeconds << " s before until " << postTriggerSeconds << " s after" << endl;
+		reply = "OK trigger";
+	}
+	else if (sessionMode == 0)
+	{
+		// Without session mode recording starts right away and runs until stopped
+		if (command == "stop" || command == "quit")
+		{
+			stopRecording = true;
+			cout << "Recording stopped by command" << endl;
+			reply = "OK stopped";
+			return false;
+		}
+		else if (command == "start")
+		{
+			reply = "OK running";
+		}
+		else
+		{
+			reply = "ERR unknown command " + command + ", use start, stop, status, marker or trigger";
+		}
+	}
+	else if (command == "start" || command == "next")
+	{
+		if (trialRunning)
+		{
+			if (command == "start")
+			{
+				cout << "Trial " << currentTrial << " is already running" << endl;
+				reply = "OK trial " + to_string(currentTrial) + " running";
+				return true;
+			}
+			HoldPrimaryTrigger(sessions);
+			trialRunning = false;
+			cout << "Trial " << currentTrial << " stopped" << endl;
+		}
+
+		// The first trial records into the files created at startup
+		static bool firstTrial = true;
+		if (!firstTrial)
+		{
+			// Images of the stopped trial still in the stream buffers belong to its files
+			DrainGrabbedFrames(sessions);
+			currentTrial++;
+
+			// Wait until every grab thread has opened the files of the new trial, a missing camera must not miss the trial silently
+			auto rollStart = steady_clock::now();
+			if (WaitForRollover(sessions) != 0)
+			{
+				reply = "ERR trial " + to_string(currentTrial) + " not started, a camera stopped recording";
+				return true;
+			}
+			cout << "Rolled over to trial " << currentTrial << " in " << duration<double, milli>(steady_clock::now() - rollStart).count() << " ms" << endl;
+		}
+		firstTrial = false;
+
+		StartPrimaryTrigger(sessions);
+		trialRunning = true;
+		cout << "Trial " << currentTrial << " started" << endl;
+		reply = "OK trial " + to_string(currentTrial) + " started";
+	}
+	else if (command == "stop")
+	{
+		if (trialRunning)
+		{
+			HoldPrimaryTrigger(sessions);
+			trialRunning = false;
+			cout << "Trial " << currentTrial << " stopped" << endl;
+		}
+		reply = "OK trial " + to_string(currentTrial) + " stopped";
+	}
+	else if (command == "quit")
+	{
+		if (trialRunning)
+		{
+			HoldPrimaryTrigger(sessions);
+			trialRunning = false;
+			cout << "Trial " << currentTrial << " stopped" << endl;
+		}
+		stopRecording = true;
+		reply = "OK quit";
+		return false;
+	}
+	else if (!command.empty())
+	{
+		cout << "Unknown command " << command << ", use start, stop, next, quit, status, marker or trigger" << endl;
+		reply = "ERR unknown command " + command;
+	}
+	return true;
+}
+
+bool HandleCommand(string command, vector<CameraSession>& sessions, string& reply)
+{
+	// strip line endings of clients that send \r\n
+	command.erase(command.find_last_not_of("\r\n ") + 1);
+
+	ghCommandMutex.lock();
+	bool keepRunning = !stopRecording && ExecuteCommand(command, sessions, reply);
+	ghCommandMutex.unlock();
+
+	if (reply.empty())
+	{
+		reply = stopRecording ? "ERR recording stopped" : "OK";
+	}
+	return keepRunning;
+}
+
+/*
+=================
+The function RunSession reads session mode commands from the console until quit. It runs in its own thread, so that the control channel can end the session as well, and checks stopRecording between lines, so the main thread can join it once recording has ended.
+=================
+*/
+void RunSession(vector<CameraSession>& sessions)
+{
+
+	cout << endl << "*** SESSION MODE ***" << endl << endl;
+	cout << "Cameras are armed. Enter start, stop, next, quit, status, marker <text> or trigger:" << endl;
+
+	string command;
+	string reply;
+	while (!stopRecording)
+	{
+		int lineRead = ReadConsoleLine(command, 100);
+		if (lineRead < 0)
+		{
+			break;
+		}
+		if (lineRead == 0)
+		{
+			continue;
+		}
+		command.erase(command.find_last_not_of(" \t\r") + 1);
+		reply.clear();
+		bool keepRunning = HandleCommand(command, sessions, reply);
+		if (command.rfind("status", 0) == 0)
+		{
+			cout << reply << endl;
+		}
+		if (!keepRunning)
+		{
+			return;
+		}
+	}
+
+	// console closed
+	if (!stopRecording)
+	{
+		HandleCommand("quit", sessions, reply);
+	}
+}
+
+/*
+=================
+The function ControlServer listens on the control channel, a named pipe on Windows and a unix domain socket otherwise. One client at a time sends commands terminated by a newline and gets one answer line per command, e.g. from experiment software. It runs in its own thread until StopControlServer ends it after recording.
+=================
+*/
+#if defined(_WIN32)
+typedef HANDLE ControlConnection;
+#else
+typedef int ControlConnection;
+std::atomic<int> controlListener(-1);
+std::atomic<int> controlClient(-1);
+#endif
+std::atomic<bool> controlServerDone(false);
+
+int ReadControl(ControlConnection connection, char* buffer, int size)
+{
+#if defined(_WIN32)
+	DWORD bytesRead = 0;
+	if (!ReadFile(connection, buffer, size, &bytesRead, NULL))
+	{
+		return 0;
+	}
+	return (int)bytesRead;
+#else
+	ssize_t bytesRead = read(connection, buffer, size);
+	return bytesRead > 0 ? (int)bytesRead : 0;
+#endif
+}
+
+void WriteControl(ControlConnection connection, string reply)
+{
+	reply += "\n";
+#if defined(_WIN32)
+	DWORD bytesWritten = 0;
+	WriteFile(connection, reply.c_str(), (DWORD)reply.size(), &bytesWritten, NULL);
+#else
+	ssize_t bytesWritten = write(connection, reply.c_str(), reply.size());
+	(void)bytesWritten;
+#endif
+}
+
+void ServeControlClient(ControlConnection connection, vector<CameraSession>& sessions)
+{
+	string pending;
+	char buffer[512];
+	int bytesRead;
+	while ((bytesRead = ReadControl(connection, buffer, sizeof(buffer))) > 0)
+	{
+		pending.append(buffer, bytesRead);
+
+		size_t newline;
+		while ((newline = pending.find('\n')) != string::npos)
+		{
+			string command = pending.substr(0, newline);
+			pending.erase(0, newline + 1);
+
+			string reply;
+			bool keepRunning = HandleCommand(command, sessions, reply);
+			WriteControl(connection, reply);
+			if (!keepRunning)
+			{
+				return;
+			}
+		}
+	}
+}
+
+void ControlServer(vector<CameraSession>& sessions)
+{
+	cout << "Control channel listening on " << controlChannel << endl;
+
+#if defined(_WIN32)
+	while (!stopRecording)
+	{
+		HANDLE pipe = CreateNamedPipeA(controlChannel.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 4096, 4096, 0, NULL);
+		if (pipe == INVALID_HANDLE_VALUE)
+		{
+			cout << "Unable to create control pipe " << controlChannel << ". Aborting..." << endl;
+			break;
+		}
+
+		bool connected = ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED;
+		if (connected && !stopRecording)
+		{
+			ServeControlClient(pipe, sessions);
+			FlushFileBuffers(pipe);
+		}
+		DisconnectNamedPipe(pipe);
+		CloseHandle(pipe);
+	}
+#else
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, controlChannel.c_str(), sizeof(address.sun_path) - 1);
+	unlink(controlChannel.c_str());
+
+	if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 1) != 0)
+	{
+		cout << "Unable to create control socket " << controlChannel << ". Aborting..." << endl;
+		if (listener >= 0) close(listener);
+		controlServerDone = true;
+		return;
+	}
+	controlListener = listener;
+
+	while (!stopRecording)
+	{
+		int client = accept(listener, nullptr, nullptr);
+		if (client < 0)
+		{
+			break;
+		}
+		controlClient = client;
+		if (!stopRecording)
+		{
+			ServeControlClient(client, sessions);
+		}
+		controlClient = -1;
+		close(client);
+	}
+
+	controlListener = -1;
+	close(listener);
+	unlink(controlChannel.c_str());
+#endif
+	controlServerDone = true;
+}
+
+void StopControlServer(thread& controlThread)
+{
+	// Unblock the server until it notices stopRecording, it may be waiting for a client or a command
+	this_thread::sleep_for(milliseconds(50));
+	while (!controlServerDone)
+	{
+#if defined(_WIN32)
+		CancelSynchronousIo(controlThread.native_handle());
+#else
+		int listener = controlListener;
+		int client = controlClient;
+		if (listener >= 0) shutdown(listener, SHUT_RDWR);
+		if (client >= 0) shutdown(client, SHUT_RDWR);
+#endif
+		this_thread::sleep_for(milliseconds(50));
+	}
+	controlThread.join();
+}
+
+/*
+=================
+The function PlanThreadLayout reads grabCores and writerCores before the threads are started. Camera i gets the i-th core of grabCores, with fewer cores than cameras the cores are used in turn. Cores that do not exist are dropped. ReportThreadLayout prints the layout the threads actually got once all grab threads wait on the start barrier, ReportGrabJitter prints the jitter of every grab loop after recording.
+=================
+*/
+int PlanThreadLayout(vector<CameraSession>& sessions)
+{
+	const int coreCount = (int)std::thread::hardware_concurrency();
+	auto validCores = [coreCount](vector<int> cores, string name)
+	{
+		size_t listed = cores.size();
+		cores.erase(remove_if(cores.begin(), cores.end(), [coreCount](int core) { return core < 0 || core >= coreCount || core >= 64; }), cores.end());
+		if (cores.size() < listed)
+		{
+			cout << "Warning: " << listed - cores.size() << " cores of " << name << " do not exist on this machine with " << coreCount << " cores!" << endl;
+		}
+		return cores;
+	};
+
+	try
+	{
+		grabCoreList = validCores(ParseCores(grabCores), "grabCores");
+		writerCoreList = validCores(ParseCores(writerCores), "writerCores");
+	}
+	catch (std::exception&)
+	{
+		cout << "Unable to read core lists grabCores=" << grabCores << " writerCores=" << writerCores << ". Aborting..." << endl;
+		return -1;
+	}
+
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		sessions[i].grabCore = grabCoreList.empty() ? -1 : grabCoreList[i % grabCoreList.size()];
+	}
+	if (grabCoreList.size() > 0 && grabCoreList.size() < sessions.size())
+	{
+		cout << "Warning: " << sessions.size() << " cameras share " << grabCoreList.size() << " grab cores!" << endl;
+	}
+	for (int core : writerCoreList)
+	{
+		if (find(grabCoreList.begin(), grabCoreList.end(), core) != grabCoreList.end())
+		{
+			cout << "Warning: core " << core << " is in grabCores and writerCores!" << endl;
+		}
+	}
+	return 0;
+}
+
+void ReportThreadLayout(vector<CameraSession>& sessions)
+{
+	cout << endl << "Thread layout on " << std::thread::hardware_concurrency() << " cores:" << endl;
+	for (CameraSession& session : sessions)
+	{
+		cout << "Camera [" << session.serialNumber << "] grab thread: " << session.grabLayout << endl;
+	}
+
+	string writerLayout = "any core";
+	if (!writerCoreList.empty())
+	{
+		writerLayout = "cores ";
+		for (size_t i = 0; i < writerCoreList.size(); i++)
+		{
+			writerLayout += (i > 0 ? "," : "") + to_string(writerCoreList[i]);
+		}
+	}
+	if (UsesFrameRings())
+	{
+		cout << "Ring writer threads: " << writerLayout << endl;
+	}
+	if (segmentFrames > 0 && convertSegments == 1)
+	{
+		cout << "Background conversion: " << writerLayout << endl;
+	}
+	cout << endl;
+}
+
+void ReportGrabJitter(vector<CameraSession>& sessions)
+{
+	cout << endl << "Grab loop jitter (host arrival interval minus camera interval):" << endl;
+	cout << "Serial\t\tThread\t\tFrames\tStdDev [us]\tMax [us]" << endl;
+	for (CameraSession& session : sessions)
+	{
+		const GrabJitter& jitter = session.jitter;
+		if (jitter.frames == 0)
+		{
+			continue;
+		}
+		double mean = jitter.sumUs / jitter.frames;
+		double stdDev = sqrt(max(0.0, jitter.sumSquaresUs / jitter.frames - mean * mean));
+		cout << session.serialNumber << "\t" << session.grabLayout << "\t" << jitter.frames << "\t" << stdDev << "\t\t" << jitter.maxUs << endl;
+	}
+}
+
+/*
+=================
+The function ProcessCpuSeconds returns the CPU time of all threads of RECtoBIN so far, including the threads of the SDK. ReportAcquisitionBenchmark prints the CPU load of the recording and, with latencyBenchmark = 1, the delivery latency of every camera, run one recording with acquisitionMode = poll and one with event to compare both. Latencies are left out with preTriggerSeconds > 0, where frames wait in the ring for their trigger on purpose.
+=================
+*/
+double ProcessCpuSeconds()
+{
+#if defined(_WIN32)
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		return 0.0;
+	}
+	auto toULL = [](FILETIME t) { return ((unsigned long long)t.dwHighDateTime << 32) | t.dwLowDateTime; };
+	return (toULL(kernelTime) + toULL(userTime)) / 1e7; // 100 ns units
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+void ReportAcquisitionBenchmark(vector<CameraSession>& sessions, double cpuSeconds, double wallSeconds)
+{
+	cout << endl << "Acquisition benchmark, acquisitionMode=" << acquisitionMode << ":" << endl;
+	if (latencyBenchmark == 1 && preTriggerSeconds <= 0)
+	{
+		cout << "Serial\t\tFrames\tMedian\t99%\tMax latency [ms]" << endl;
+		for (CameraSession& session : sessions)
+		{
+			vector<int64_t>& latencies = session.latency.writtenNs;
+			if (latencies.empty())
+			{
+				continue;
+			}
+			for (int64_t& latency : latencies)
+			{
+				latency -= session.latency.fastestNs;
+			}
+			sort(latencies.begin(), latencies.end());
+			size_t samples = latencies.size();
+			cout << session.serialNumber << "\t" << session.latency.frames << "\t" << latencies[samples / 2] / 1e6 << "\t" << latencies[min(samples - 1, samples * 99 / 100)] / 1e6
+				<< "\t" << (session.latency.slowestNs - session.latency.fastestNs) / 1e6 << endl;
+		}
+	}
+	if (wallSeconds > 0)
+	{
+		cout << "CPU " << cpuSeconds << " s in " << wallSeconds << " s of recording, " << 100.0 * cpuSeconds / wallSeconds << "% of one core" << endl;
+	}
+}
+
+/*
+=================
+The struct StartBarrier holds the grab threads back until all cameras are ready. Each grab thread calls Arrive once its stream is purged and waits in WaitStart, the main thread waits in WaitArrived for all grab threads and releases them together with Start.
+=================
+*/
+struct StartBarrier
+{
+	std::mutex lock;
+	std::condition_variable changed;
+	unsigned int arrived = 0;
+	bool started = false;
+
+	void Arrive()
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			arrived++;
+		}
+		changed.notify_all();
+	}
+
+	void WaitArrived(unsigned int threads)
+	{
+		unique_lock<mutex> guard(lock);
+		changed.wait(guard, [&] { return arrived >= threads; });
+	}
+
+	void Start()
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			started = true;
+		}
+		changed.notify_all();
+	}
+
+	void WaitStart()
+	{
+		unique_lock<mutex> guard(lock);
+		changed.wait(guard, [&] { return started; });
+	}
+};
+
+StartBarrier startBarrier;
+std::atomic<unsigned int> grabThreadsRunning(0); // the main thread polls the keyboard until all grab threads have returned
+
+/*
+=================
+The class FrameEventHandler receives the images of one camera with acquisitionMode = event. OnImageEvent runs on an SDK thread and does no more than the grab loop has to do before the mutex: it timestamps the image and copies it into the frame ring of the camera, because the SDK reuses the image buffer once the callback returns. The ring writer runs the activity gate and the shared memory outputs and saves the frames.
+=================
+*/
+class FrameEventHandler : public ImageEventHandler
+{
+public:
+	FrameEventHandler(CameraSession& cameraSession) : session(cameraSession)
+	{
+	}
+
+	void OnImageEvent(ImagePtr image)
+	{
+		try
+		{
+			FrameRecord record;
+			record.hostTime = HostTimeNs();
+			record.systemTime = SystemTimeNs();
+			DecodeFrame(image, session.chunks, record);
+			record.trial = session.trial;
+			const char* imageData = static_cast<const char*>(image->GetData());
+
+			// A full ring is counted as overrun and reported by the writer thread
+			PushFrame(session.ring, imageData, record);
+			session.jitter.Add(record);
+			session.lastGrabFrameID.store(record.frameID, memory_order_relaxed);
+			session.lastGrabNs.store(record.hostTime, memory_order_release);
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "Error: " << e.what() << endl;
+		}
+	}
+
+private:
+	CameraSession& session;
+};
+
+/*
+=================
+The function WaitForImageEvents replaces the grab loop with acquisitionMode = event. It registers a FrameEventHandler, follows the trials for the ring writer and returns when the recording is stopped. Like GetNextImage without session mode, it also ends the recording once no image arrived for grabTimeout milliseconds.
+=================
+*/
+int WaitForImageEvents(CameraSession& session, uint64_t grabTimeout)
+{
+	FrameEventHandler handler(session);
+	try
+	{
+		session.pCam->RegisterEventHandler(handler);
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		cout << "Error: " << e.what() << endl;
+		return 0;
+	}
+	cout << "Camera [" << session.serialNumber << "] " << "Started recording with ID [" << session.cameraCnt << " ] on image events..." << endl;
+
+	const int64_t waitStart = HostTimeNs();
+	while (!stopRecording.load(memory_order_relaxed))
+	{
+		if (session.trial != currentTrial)
+		{
+			session.trial = currentTrial.load();
+		}
+		this_thread::sleep_for(milliseconds(10));
+
+		// A secondary machine waits for the primary machine to start
+		int64_t lastImage = session.lastGrabNs.load(memory_order_relaxed);
+		if (sessionMode == 0 && (lastImage > 0 || role != "secondary") && HostTimeNs() - max(lastImage, waitStart) > (int64_t)grabTimeout * 1000000)
+		{
+			cout << "Camera [" << session.serialNumber << "] delivered no image for " << grabTimeout << " ms" << endl;
+			cout << "stopwait activated" << endl;
+			break;
+		}
+	}
+
+	try
+	{
+		session.pCam->UnregisterEventHandler(handler);
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		cout << "Error: " << e.what() << endl;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+=================
+The function AcquireImages runs in parallel threads and grabs images from each camera and saves them in the corresponding binary file. Each image also records the image status to the logging csvFile. The camera session is already initialized and armed, the thread pins itself to its core, purges its stream buffer and waits on the start barrier before grabbing. With preTriggerSeconds > 0 or realtimePriority images are only copied into the frame ring, without locking, and WriteFramesFromRing saves and publishes them. With acquisitionMode = event the thread leaves the images to WaitForImageEvents.
+=================
+*/
+int AcquireImages(CameraSession& session)
+{
+	// START function in UN-locked thread
+	CameraPtr pCam = session.pCam;
+	const int cameraCnt = session.cameraCnt;
+	const string serialNumber = session.serialNumber;
+	const bool useEvents = acquisitionMode == "event";
+	const bool useRing = UsesFrameRings(); // always with realtimePriority, so a real-time thread never takes ghMutex
+	const bool usePreview = !useRing && previewEvery > 0 && previewMemory.base != nullptr; // the ring writer publishes ring frames
+	const bool useFanout = !useRing && fanoutMemory.base != nullptr;
+
+	// Initialize empty parameters outside of locked case
+	ImagePtr pResultImage;
+	char* imageData;
+	int firstFrame = 1;
+	int stopwait = 0;
+	int threadResult = 1;
+	uint64_t grabbed = 0;
+	bool imageSeen = false;
+	bool previewDue = false; // image is kept until it is published outside the mutex
+	bool fanoutDue = false;
+	FrameRecord publishRecord;
+
+	// Pin the thread before the start barrier, so the layout is final when recording starts
+	session.grabLayout = PinCurrentThread(session.grabCore >= 0 ? vector<int>{ session.grabCore } : vector<int>(), realtimePriority == 1);
+
+	// Drop stale images, then wait on the start barrier until all cameras are armed
+	int purged = PurgeStream(pCam);
+	if (purged > 0)
+	{
+		cout << "Camera [" << serialNumber << "] purged " << purged << " stale images" << endl;
+	}
+	startBarrier.Arrive();
+	startBarrier.WaitStart();
+
+	// In session mode the thread keeps waiting between trials and rolls over to new files when a trial starts
+	const uint64_t grabTimeout = (sessionMode == 1) ? 100 : 1000;
+
+	// With image events the SDK delivers the images and this thread only waits
+	if (useEvents)
+	{
+		threadResult = WaitForImageEvents(session, grabTimeout);
+	}
+
+	// Retrieve and save images in while loop until stopped by ESC, the console or the control channel
+	while (!useEvents && stopwait == 0 && !stopRecording.load(memory_order_relaxed))
+	{
+		if (session.trial != currentTrial)
+		{
+			int trial = currentTrial;
+
+			// With the pre-trigger ring the writer thread opens the files of the new trial
+			if (!useRing && RollTrial(cameraCnt, serialNumber, trial) != 0)
+			{
+				threadResult = 0;
+				break;
+			}
+			session.trial = trial;
+		}
+
+		// Start mutex_lock, the ring needs no lock
+		unique_lock<mutex> writeLock(ghMutex, defer_lock);
+		if (!useRing)
+		{
+			writeLock.lock();
+		}
+
+		try
+		{
+			// anounce start recordnig only for firstFrame
+			if (firstFrame == 1)
+			{
+				cout << "Camera [" << serialNumber << "] " << "Started recording with ID [" << cameraCnt << " ]..." << endl;
+			}
+			firstFrame = 0; // turn off firstFrame status
+
+			// Retrieve image and ensure image completion
+			bool imageReceived = true;
+			try
+			{
+				pResultImage = pCam->GetNextImage(grabTimeout); // waiting time for NextImage in miliseconds
+			}
+			catch (Spinnaker::Exception& e)
+			{
+				imageReceived = false;
+
+				// Between trials no images arrive, keep waiting. A secondary machine also waits for the primary machine to start.
+				if (sessionMode == 0 && (imageSeen || role != "secondary"))
+				{
+					cout << "Error: " << e.what() << endl;
+					stopwait = 1; // stopwait activated after waiting 1000ms without trigger
+					cout << "stopwait activated" << endl;
+				}
+			}
+
+			if (imageReceived)
+			{
+				imageSeen = true;
+
+				// Acquire the image buffer to write to a file
+				imageData = static_cast<char*>(pResultImage->GetData());
+
+				FrameRecord record;
+				record.hostTime = HostTimeNs();
+				record.systemTime = SystemTimeNs();
+				DecodeFrame(pResultImage, session.chunks, record);
+				record.trial = session.trial;
+				session.jitter.Add(record);
+				session.lastGrabFrameID.store(record.frameID, memory_order_relaxed);
+				session.lastGrabNs.store(record.hostTime, memory_order_release);
+
+				if (useRing)
+				{
+					// A full ring is counted as overrun and reported by the writer thread
+					PushFrame(session.ring, imageData, record);
+				}
+				else if (CommitFrame(session, imageData, record) != 0)
+				{
+					threadResult = 0;
+					stopwait = 1;
+				}
+
+				// Release image, unless it is published to shared memory below
+				previewDue = usePreview && (grabbed++ % previewEvery == 0);
+				fanoutDue = useFanout && fanoutActive.load(memory_order_relaxed) > 0;
+				if (previewDue || fanoutDue)
+				{
+					publishRecord = record;
+				}
+				else
+				{
+					pResultImage->Release();
+				}
+			}
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "Error: " << e.what() << endl;
+			threadResult = 0;
+			stopwait = 1;
+		}
+
+		// Release the mutex before publishing
+		if (!useRing)
+		{
+			writeLock.unlock();
+		}
+
+		// Publishing must not hold up the other cameras, disk writing comes first
+		if (previewDue || fanoutDue)
+		{
+			try
+			{
+				if (fanoutDue)
+				{
+					PublishFanout(session, imageData, publishRecord);
+				}
+				if (previewDue)
+				{
+					PublishPreview(session, imageData, publishRecord);
+				}
+				pResultImage->Release();
+			}
+			catch (Spinnaker::Exception& e)
+			{
+				cout << "Error: " << e.what() << endl;
+			}
+			previewDue = false;
+			fanoutDue = false;
+		}
+	}
+
+	// End acquisition, the camera stays initialized until the session is closed
+	try
+	{
+		pCam->EndAcquisition();
+		session.armed = false;
+	}
+	catch (Spinnaker::Exception& e)
+	{
+		cout << "Error: " << e.what() << endl;
+		threadResult = 0;
+	}
+
+	if (useRing)
+	{
+		// The writer thread saves the remaining frames and closes the files
+		session.ring.closed.store(true, memory_order_release);
+	}
+	else if (segmentFrames > 0)
+	{
+		FinishSegment(cameraCnt);
+	}
+	else
+	{
+		cameraSinks[cameraCnt]->Close();
+	}
+
+	return threadResult;
+}
+
+/*
+=================
+The function ArmCameraSessions starts acquisition on all cameras, secondary cameras first so that they are waiting for the hardware trigger. The primary camera is held in trigger mode and produces no images until StartPrimaryTrigger. The function CloseCameraSessions deinitializes all cameras after recording.
+=================
+*/
+int ArmCameraSessions(vector<CameraSession>& sessions)
+{
+	int result = 0;
+	cout << endl << "*** ARMING CAMERAS ***" << endl << endl;
+
+	for (int primaryPass = 0; primaryPass < 2; primaryPass++)
+	{
+		for (CameraSession& session : sessions)
+		{
+			if (session.primary != (primaryPass == 1) || session.result != 0)
+			{
+				continue;
+			}
+
+			try
+			{
+				session.pCam->BeginAcquisition();
+				session.armed = true;
+				cout << "Camera [" << session.serialNumber << "] armed" << (session.primary ? " as primary" : "") << endl;
+			}
+			catch (Spinnaker::Exception& e)
+			{
+				cout << "Error: " << e.what() << endl;
+				result = -1;
+			}
+		}
+	}
+	return result;
+}
+
+void CloseCameraSessions(vector<CameraSession>& sessions)
+{
+	for (CameraSession& session : sessions)
+	{
+		try
+		{
+			if (session.armed)
+			{
+				session.pCam->EndAcquisition();
+				session.armed = false;
+			}
+			if (session.pCam && session.pCam->IsInitialized())
+			{
+				session.pCam->DeInit();
+			}
+		}
+		catch (Spinnaker::Exception& e)
+		{
+			cout << "Error: " << e.what() << endl;
+		}
+		session.pCam = nullptr;
+	}
+}
+
+/*
+=================
+The functions SendLine and ReadLine exchange the newline terminated messages of the coordinator protocol between the primary and the secondary machines.
+=================
+*/
+bool SendLine(SinkSocket socketHandle, string line)
+{
+	line += "\n";
+	SinkPart parts[1] = { { line.c_str(), line.size() } };
+	return SendParts(socketHandle, parts, 1);
+}
+
+struct LineReader
+{
+	SinkSocket socketHandle;
+	string pending;
+
+	bool ReadLine(string& line)
+	{
+		size_t newline;
+		while ((newline = pending.find('\n')) == string::npos)
+		{
+			char buffer[4096];
+			int received = recv(socketHandle, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+			{
+				return false;
+			}
+			pending.append(buffer, received);
+		}
+		line = pending.substr(0, newline);
+		pending.erase(0, newline + 1);
+		return true;
+	}
+};
+
+/*
+=================
+The primary machine runs the coordinator. StartCoordinator creates the merged session index and accepts secondaryMachines connections, each served by ServeSecondary in its own thread. StopSecondaries joins these threads and closes their sockets before it closes the session index. A secondary says HELLO and gets the session name, so all machines use the same file names. It then measures the clock offset with PING/PONG probes, reports READY once its cameras are armed and streams its log records, which are written to the session index with the machine name and the system time converted to the clock of the primary. The primary sends STOP after recording and the secondary answers DONE after its last records.
+=================
+*/
+ofstream sessionIndex;
+std::mutex ghIndexMutex;
+vector<SinkSocket> secondarySockets;
+vector<thread> serveThreads;
+thread acceptThread;
+SinkSocket coordinatorListener = INVALID_SOCKET;
+std::atomic<int> secondariesReady(0);
+std::atomic<int> secondariesDone(0);
+
+void AppendSessionIndex(const string& lines)
+{
+	ghIndexMutex.lock();
+	sessionIndex << lines;
+	ghIndexMutex.unlock();
+}
+
+void ServeSecondary(int machine)
+{
+	const string machineName = "secondary" + to_string(machine + 1);
+	ghIndexMutex.lock();
+	LineReader reader = { secondarySockets[machine], string() };
+	ghIndexMutex.unlock();
+	string line;
+	string records;
+
+	while (reader.ReadLine(line))
+	{
+		if (line.rfind("L,", 0) == 0)
+		{
+			records += machineName + line.substr(1) + "\n";
+			if (records.size() > 65536)
+			{
+				AppendSessionIndex(records);
+				records.clear();
+			}
+			continue;
+		}
+
+		if (!records.empty())
+		{
+			AppendSessionIndex(records);
+			records.clear();
+		}
+
+		if (line.rfind("HELLO", 0) == 0)
+		{
+			cout << "Machine " << machineName << " connected: " << line.substr(5) << endl;
+			SendLine(reader.socketHandle, "SESSION " + sessionDateTime);
+		}
+		else if (line.rfind("PING ", 0) == 0)
+		{
+			int64_t received = SystemTimeNs();
+			SendLine(reader.socketHandle, "PONG " + line.substr(5) + " " + to_string(received) + " " + to_string(SystemTimeNs()));
+		}
+		else if (line.rfind("OFFSET ", 0) == 0)
+		{
+			cout << "Machine " << machineName << " clock offset " << line.substr(7) << endl;
+		}
+		else if (line == "READY")
+		{
+			secondariesReady++;
+			cout << "Machine " << machineName << " armed" << endl;
+		}
+		else if (line == "DONE")
+		{
+			break;
+		}
+	}
+
+	if (!records.empty())
+	{
+		AppendSessionIndex(records);
+	}
+	secondariesDone++;
+}
+
+void AcceptSecondaries(SinkSocket listener)
+{
+	for (int machine = 0; machine < secondaryMachines; machine++)
+	{
+		SinkSocket connection = accept(listener, nullptr, nullptr);
+		if (connection == INVALID_SOCKET)
+		{
+			break;
+		}
+
+		ghIndexMutex.lock();
+		secondarySockets.push_back(connection);
+		serveThreads.emplace_back(ServeSecondary, machine);
+		ghIndexMutex.unlock();
+	}
+}
+
+int StartCoordinator()
+{
+	secondarySockets.reserve(secondaryMachines);
+
+	string sessionIndexFilename = path + "session_" + sessionDateTime + ".csv";
+	sessionIndex.open(sessionIndexFilename);
+	if (!sessionIndex.is_open())
+	{
+		cout << "Unable to create session index " << sessionIndexFilename << ". Aborting..." << endl;
+		return -1;
+	}
+	sessionIndex << "Machine" << "," << "FrameID" << "," << "Timestamp" << "," << "SerialNumber" << "," << "FileNumber" << "," << "SystemTimeInNanoseconds" << "," << "Trial" << endl;
+
+	SinkSocket listener = socket(AF_INET, SOCK_STREAM, 0);
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((unsigned short)coordinatorPort);
+	if (listener == INVALID_SOCKET || bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, secondaryMachines) != 0)
+	{
+		cout << "Unable to listen for secondary machines on port " << coordinatorPort << ". Aborting..." << endl;
+		return -1;
+	}
+
+	coordinatorListener = listener;
+	acceptThread = thread(AcceptSecondaries, listener);
+
+	coordinated = true;
+	coordinatorPrefix = "primary,";
+	cout << "Session index " << sessionIndexFilename << ", waiting for " << secondaryMachines << " secondary machines on port " << coordinatorPort << endl;
+	return 0;
+}
+
+int WaitForSecondaries()
+{
+	cout << "Waiting for secondary machines to arm their cameras..." << endl;
+	while (secondariesReady < secondaryMachines)
+	{
+		if (stopRecording || EscapePressed())
+		{
+			cout << "Stopped waiting for secondary machines" << endl;
+			return -1;
+		}
+		this_thread::sleep_for(milliseconds(50));
+	}
+	cout << "All " << secondaryMachines << " secondary machines armed" << endl;
+	return 0;
+}
+
+void StopSecondaries()
+{
+	ghIndexMutex.lock();
+	vector<SinkSocket> connections = secondarySockets;
+	ghIndexMutex.unlock();
+
+	for (SinkSocket connection : connections)
+	{
+		SendLine(connection, "STOP");
+	}
+
+	// Secondary machines finish their last records, wait at most 30 seconds
+	auto stopStart = steady_clock::now();
+	while (secondariesDone < (int)connections.size() && steady_clock::now() - stopStart < seconds(30))
+	{
+		this_thread::sleep_for(milliseconds(50));
+	}
+	if (secondariesDone < (int)connections.size())
+	{
+		cout << "Warning: " << connections.size() - secondariesDone << " secondary machines did not finish their log records!" << endl;
+	}
+
+	// Wake up the threads still waiting in accept or recv, none of them may write to the index once it is closed
+	shutdown(coordinatorListener, 2); // SD_BOTH, SHUT_RDWR
+	CloseSocket(coordinatorListener);
+	if (acceptThread.joinable())
+	{
+		acceptThread.join();
+	}
+	for (SinkSocket connection : secondarySockets)
+	{
+		shutdown(connection, 2);
+	}
+	for (thread& serveThread : serveThreads)
+	{
+		serveThread.join();
+	}
+	for (SinkSocket connection : secondarySockets)
+	{
+		CloseSocket(connection);
+	}
+
+	sessionIndex.close();
+}
+
+/*
+=================
+A secondary machine connects with ConnectCoordinator before its cameras are configured, takes over the session name and estimates its clock offset from 16 PING/PONG probes. The probe with the shortest round trip gives offset = ((t2 - t1) + (t3 - t4)) / 2, as in NTP. WatchPrimary waits for STOP in its own thread.
+=================
+*/
+SinkSocket coordinatorSocket = INVALID_SOCKET;
+LineReader primaryReader;
+
+int ConnectCoordinator()
+{
+	struct addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo* addresses = nullptr;
+	if (getaddrinfo(coordinatorHost.c_str(), to_string(coordinatorPort).c_str(), &hints, &addresses) != 0)
+	{
+		cout << "Unable to resolve coordinatorHost " << coordinatorHost << ". Aborting..." << endl;
+		return -1;
+	}
+
+	// The primary machine may still be starting, try for 60 seconds
+	cout << "Connecting to primary machine " << coordinatorHost << ":" << coordinatorPort << "..." << endl;
+	auto connectStart = steady_clock::now();
+	while (coordinatorSocket == INVALID_SOCKET && steady_clock::now() - connectStart < seconds(60))
+	{
+		coordinatorSocket = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+		if (connect(coordinatorSocket, addresses->ai_addr, (int)addresses->ai_addrlen) != 0)
+		{
+			CloseSocket(coordinatorSocket);
+			coordinatorSocket = INVALID_SOCKET;
+			this_thread::sleep_for(milliseconds(500));
+		}
+	}
+	freeaddrinfo(addresses);
+	if (coordinatorSocket == INVALID_SOCKET)
+	{
+		cout << "Unable to connect to primary machine. Aborting..." << endl;
+		return -1;
+	}
+	primaryReader.socketHandle = coordinatorSocket;
+
+	char hostname[256] = "unknown";
+	gethostname(hostname, sizeof(hostname));
+
+	string line;
+	SendLine(coordinatorSocket, "HELLO " + string(hostname));
+	if (!primaryReader.ReadLine(line) || line.rfind("SESSION ", 0) != 0)
+	{
+		cout << "No session name from primary machine. Aborting..." << endl;
+		return -1;
+	}
+	sessionDateTime = line.substr(8);
+
+	// Clock offset from the probe with the shortest round trip
+	int64_t bestDelay = INT64_MAX;
+	for (int probe = 0; probe < 16; probe++)
+	{
+		int64_t t1 = SystemTimeNs();
+		SendLine(coordinatorSocket, "PING " + to_string(t1));
+		if (!primaryReader.ReadLine(line))
+		{
+			cout << "Primary machine closed the connection. Aborting..." << endl;
+			return -1;
+		}
+		int64_t t4 = SystemTimeNs();
+
+		long long echoed = 0, t2 = 0, t3 = 0;
+		if (sscanf(line.c_str(), "PONG %lld %lld %lld", &echoed, &t2, &t3) != 3 || echoed != t1)
+		{
+			continue;
+		}
+		int64_t delay = (t4 - t1) - (t3 - t2);
+		if (delay < bestDelay)
+		{
+			bestDelay = delay;
+			clockOffsetNs = ((t2 - t1) + (t3 - t4)) / 2;
+		}
+	}
+
+	string offset = to_string(clockOffsetNs / 1000) + " us, round trip " + to_string(bestDelay / 1000) + " us";
+	cout << "Joined session " << sessionDateTime << ", clock offset to primary machine " << offset << endl;
+	SendLine(coordinatorSocket, "OFFSET " + offset);
 
-	return result;
+	coordinated = true;
+	coordinatorPrefix = "L,";
+	return 0;
+}
+
+void WatchPrimary()
+{
+	string line;
+	while (primaryReader.ReadLine(line))
+	{
+		if (line == "STOP")
+		{
+			cout << "Recording stopped by primary machine" << endl;
+			stopRecording = true;
+			break;
+		}
+	}
 }
 
 /*
 =================
-The function AcquireImages runs in parallel threads and grabs images from each camera and saves them in the corresponding binary file. Each image also records the image status to the logging csvFile.
+The function FlushCoordinatorLog runs in its own thread while a coordinated recording is running. Every 50 ms it takes the log records collected under ghMutex and writes them to the session index on the primary machine or sends them to the primary machine from a secondary. It returns after the last flush once coordinatorFlushDone is set.
 =================
 */
-DWORD WINAPI AcquireImages(LPVOID lpParam)
+std::atomic<bool> coordinatorFlushDone(false);
+
+void FlushCoordinatorLog()
 {
-	// START function in UN-locked thread
+	string records;
+	bool lastFlush = false;
+	while (!lastFlush)
+	{
+		lastFlush = coordinatorFlushDone;
+		this_thread::sleep_for(milliseconds(50));
 
-	// Initialize camera
-	CameraPtr pCam = *((CameraPtr*)lpParam);
-	pCam->Init();
+		ghMutex.lock();
+		records.swap(coordinatorLog);
+		ghMutex.unlock();
 
-	// Clean Buffer acquiring idle images
-	pCam->BeginAcquisition();
-	try
-	{
-		for (unsigned int imagesInBuffer = 0; imagesInBuffer < numBuffers; imagesInBuffer++)
+		if (records.empty())
 		{
-			// first numBuffer images are descarted
-			ImagePtr pResultImage = pCam->GetNextImage();
-			char* imageData = static_cast<char*>(pResultImage->GetData());
-			pResultImage->Release();
+			continue;
 		}
+		if (role == "primary")
+		{
+			AppendSessionIndex(records);
+		}
+		else if (!SendLine(coordinatorSocket, records.substr(0, records.size() - 1)))
+		{
+			cout << "Warning: lost connection to primary machine, log records are only in the local logfile!" << endl;
+			coordinated = false;
+		}
+		records.clear();
 	}
-	catch (Spinnaker::Exception& e)
-	{
-		cout << "Error: " << e.what() << endl;
-		return 1;
-	}
+}
 
-	pCam->EndAcquisition();
+/*
+=================
+The function WriteMetadata saves the recording settings for BINtoAVI. It is written before recording starts, so that finished segments can already be converted.
+=================
+*/
+void WriteMetadata()
+{
+	cout << endl << "Metadata file: " << metadataFilename << " saved in " << path << endl << endl;
 
-	// Start actual image acquisition
-	pCam->BeginAcquisition();
+	metadataFile.open(metadataFilename);
+	metadataFile << "# This is the metadata summarizing recording parameters" << endl;
+	metadataFile << "Filename=" << metadataFilename << endl;
+	metadataFile << "Framerate=" << NewFrameRate << endl;
+	metadataFile << "ImageHeight=" << heightToSet << endl;
+	metadataFile << "ImageWidth=" << widthToSet << endl;
+	metadataFile << "# Change ColorVideo = 1/0, chosenVideoType =UNCOMPRESSED/MJPG/H264/PIPE and VideoPath" << endl;
+	metadataFile << "# With chosenVideoType=PIPE raw frames are streamed to EncoderCommand, e.g. ffmpeg reading rawvideo from stdin, {output} is quoted by BINtoAVI" << endl;
+	metadataFile << "ColorVideo=1" << endl;
+	metadataFile << "chosenVideoType=UNCOMPRESSED" << endl;
+	metadataFile << "VideoPath=" << path << endl;
+	metadataFile << "# Uncomment RetimeLog to place frames on a constant 1/Framerate grid, GapFill =DUPLICATE/BLANK fills dropped frames" << endl;
+	metadataFile << "#RetimeLog=" << csvFilename << endl;
+	metadataFile << "GapFill=DUPLICATE" << endl;
+	metadataFile << "# Uncomment SyncTable to align frames with the table saved by LOGtoSYNC instead of RetimeLog" << endl;
+	metadataFile << "#SyncTable=" << endl;
+	metadataFile << "# Mosaic=1 tiles all converted files into one video, requires RetimeLog" << endl;
+	metadataFile << "Mosaic=0" << endl;
+	metadataFile << "MosaicColumns=3" << endl;
+	metadataFile << "MosaicScale=2" << endl;
+	metadataFile << "# ProxyScale >1 exports low resolution proxy videos, must be even for color" << endl;
+	metadataFile << "ProxyScale=1" << endl;
+	metadataFile.close();
+}
 
-	// Initialize empty parameters outside of locked case
-	ImagePtr pResultImage;
-	char* imageData;
-	string deviceUser_ID;
-	int firstFrame = 1;
-	int stopwait = 0;
+/*
+=================
+The function RecordMultipleCameraThreads acts as the body of the program. It calls the InitializeMultipleCameras function to configure all cameras and aborts if any camera can not be configured or armed, then creates parallel threads and starts AcquireImages on each thred. With the setting configured above, threads are waiting for synchronized trigger as a central clock.
+=================
+*/
+int RecordMultipleCameraThreads(CameraList camList)
+{
+	int result = 0;
+	unsigned int camListSize = 0;
 
-	// Retrieve and save images in while loop until manual ESC press
-	while (GetAsyncKeyState(VK_ESCAPE) == 0)
+	try
 	{
-		// Start mutex_lock
-		DWORD dwCount = 0, dwWaitResult;
-		dwWaitResult = WaitForSingleObject(
-			ghMutex,    // handle to mutex
-			INFINITE);  // no time-out interval
-		switch (dwWaitResult)
-		{
+		// Retrieve camera list size
+		camListSize = camList.GetSize();
 
-			// The thread got ownership of the mutex
-		case WAIT_OBJECT_0:
+		// One session per camera, kept initialized from configuration through recording
+		vector<CameraSession> sessions(camListSize);
 
-			try
+		// The primary machine names the session, secondaries take over its name before creating files
+		if (role == "primary")
+		{
+			sessionDateTime = getCurrentDateTime();
+			if (StartCoordinator() != 0)
 			{
-				// Identify specific camera in locked thread
-				INodeMap& nodeMapTLDevice = pCam->GetTLDeviceNodeMap();
-				CStringPtr ptrStringSerial = pCam->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
-				if (IsAvailable(ptrStringSerial) && IsReadable(ptrStringSerial))
-				{
-					serialNumber = ptrStringSerial->GetValue();
-				}
-
-				INodeMap& nodeMap = pCam->GetNodeMap();
-				CStringPtr ptrDeviceUserId = pCam->GetNodeMap().GetNode("DeviceUserID");
-				if (IsAvailable(ptrDeviceUserId) && IsReadable(ptrDeviceUserId))
-				{
-					deviceUser_ID = ptrDeviceUserId->GetValue();
-					cameraCnt = atoi(deviceUser_ID.c_str());
-				}
-
-				// anounce start recordnig only for firstFrame
-				if (firstFrame == 1)
-				{
-					cout << "Camera [" << serialNumber << "] " << "Started recording with ID [" << cameraCnt << " ]..." << endl;
-				}
-				firstFrame = 0; // turn off firstFrame status
-
-				// Break recording loop is stopwait status has been activated
-				if (stopwait == 1)
-				{
-					break;
-				}
-
-				// Retrieve image and ensure image completion
-				try
-				{
-					pResultImage = pCam->GetNextImage(1000); // waiting time for NextImage in miliseconds
-				}
-				catch (Spinnaker::Exception& e)
-				{
-					cout << "Error: " << e.what() << endl;
-					stopwait == 1; // stopwait activated after waiting 1000ms without trigger
-					cout << "stopwait activated" << endl;
-				}
+				return -1;
+			}
+		}
+		else if (role == "secondary" && ConnectCoordinator() != 0)
+		{
+			return -1;
+		}
 
-				// Acquire the image buffer to write to a file
-				imageData = static_cast<char*>(pResultImage->GetData());
+		// Initialize cameras in camList, a camera that failed would leave a gap in the recording
+		if (InitializeMultipleCameras(camList, sessions) != 0)
+		{
+			cout << "Camera configuration failed, check the table above. Aborting..." << endl;
+			csvFile.close();
+			CloseCameraSessions(sessions);
+			return -1;
+		}
 
-				// Do the writing to assigned cameraFile
-				cameraFiles[cameraCnt].write(imageData, pResultImage->GetImageSize());
+		if (acquisitionMode != "poll" && acquisitionMode != "event")
+		{
+			cout << "Warning: unknown acquisitionMode " << acquisitionMode << ", using poll!" << endl;
+			acquisitionMode = "poll";
+		}
 
-				csvFile << pResultImage->GetFrameID() << "," << pResultImage->GetTimeStamp() << "," << serialNumber << "," << cameraCnt << endl;
+		// Stream buffers, frame rings and shared memory of all cameras within the RAM budget
+		if (PlanCameraMemory(sessions) != 0)
+		{
+			csvFile.close();
+			CloseCameraSessions(sessions);
+			return -1;
+		}
 
-				//TODO add system time to see if frame id 0 (secondary cams) corresponds to frame id 0 (primary cam)
-				//CAUTION: slows down recording loop...
-				//csvFile << pResultImage->GetFrameID() << "," << pResultImage->GetTimeStamp() << "," << serialNumber << "," << cameraCnt << "," << getTimeStamp() << endl; 
+		// Balance the USB bandwidth of cameras sharing a host controller
+		if (controllerBandwidth > 0 && PlanCameraBandwidth(sessions) != 0)
+		{
+			csvFile.close();
+			CloseCameraSessions(sessions);
+			return -1;
+		}
 
-				// Check if the writing is successful
-				if (!cameraFiles[cameraCnt].good())
-				{
-					cout << "Error writing to file for camera " << cameraCnt << " !" << endl;
-					return -1;
-				}
+		// Assign cameras to volumes and make sure the disks keep up before the recording depends on them
+		if (PlanVolumes(sessions) != 0)
+		{
+			csvFile.close();
+			CloseCameraSessions(sessions);
+			return -1;
+		}
 
-				// Release image
-				pResultImage->Release();
+		// Cores and priority of the recording threads
+		if (PlanThreadLayout(sessions) != 0)
+		{
+			csvFile.close();
+			CloseCameraSessions(sessions);
+			return -1;
+		}
 
-			}
-			catch (Spinnaker::Exception& e)
+		// Create binary files on the assigned volumes
+		for (CameraSession& session : sessions)
+		{
+			if (CreateFiles(session.serialNumber, session.cameraCnt, cout) != 0)
 			{
-				cout << "Error: " << e.what() << endl;
+				csvFile.close();
+				CloseCameraSessions(sessions);
 				return -1;
 			}
+		}
 
-			// normal break
-			ReleaseMutex(ghMutex);
-			break;
+		// Keep the last seconds of frames in RAM and only save them around trigger events, image events always queue their frames in RAM
+		const bool useRings = UsesFrameRings();
+		if (useRings && AllocateFrameRings(sessions) != 0)
+		{
+			csvFile.close();
+			CloseCameraSessions(sessions);
+			return -1;
+		}
 
-			// The thread got ownership of an abandoned mutex
-		case WAIT_ABANDONED:
-			cout << "wait abandoned" << endl;
+		// The activity gate takes its pre-roll from the pre-trigger ring
+		if (gateCamera == "primary")
+		{
+			gateCamera = triggerCam;
+		}
+		if (!gateCamera.empty())
+		{
+			if (preTriggerSeconds <= 0)
+			{
+				cout << "Warning: gateCamera requires preTriggerSeconds > 0, activity gate disabled!" << endl;
+				gateCamera.clear();
+			}
+			else if (gateScale < 2 || gateScale > 16)
+			{
+				cout << "Warning: gateScale must be between 2 and 16, using 8" << endl;
+				gateScale = 8;
+			}
+			if (!gateCamera.empty())
+			{
+				cout << "Activity gate on camera [" << gateCamera << "] opens at " << gateOn << " and closes below " << gateOff << endl;
+			}
 		}
-	}
 
-	// End acquisition
-	pCam->EndAcquisition();
-	cameraFiles[cameraCnt].close();
-	csvFile.close();
+		// Live preview for external viewers
+		if (previewEvery > 0)
+		{
+			CreatePreview(sessions);
+		}
 
-	// Deinitialize camera
-	pCam->DeInit();
+		// Full-rate frames for local consumer processes
+		if (fanoutSlots > 0)
+		{
+			CreateFanout(sessions);
+		}
 
-	return 1;
-}
+		// Save metadata with recording settings
+		WriteMetadata();
 
-/*
-=================
-The function InitializeMultipleCameras bundles the initialization process for all cameras on the system. It is called in RecordMultipleCameraThreads and starts a loop to set Buffer, Strobe, Exposure and Trigger, as well as to create binary files for each camera.
-=================
-*/
-int InitializeMultipleCameras(CameraList camList, CameraPtr* pCamList, unsigned int camListSize)
-{
-	int result = 0;
+		// Start acquisition once on all cameras, a camera that is not armed would never deliver images
+		if (ArmCameraSessions(sessions) != 0)
+		{
+			cout << "Unable to arm all cameras. Aborting..." << endl;
+			csvFile.close();
+			CloseCameraSessions(sessions);
+			CloseSharedMemory(previewMemory, true);
+			CloseSharedMemory(fanoutMemory, true);
+			return -1;
+		}
 
-	try
-	{
-		for (unsigned int i = 0; i < camListSize; i++)
+		// Start converting finished segments while recording
+		thread converterThread;
+		if (segmentFrames > 0 && convertSegments == 1 && !sinkHost.empty())
+		{
+			cout << "Warning: segments streamed to " << sinkHost << " are converted on the storage node, convertSegments disabled!" << endl;
+		}
+		else if (segmentFrames > 0 && convertSegments == 1)
 		{
-			// Select camera in loop
-			pCamList[i] = camList.GetByIndex(i); // TODO: try to get order USB Interface/primary vs secondary // get serial
-			pCamList[i]->Init();
+			recordingDone = false;
+			converterThread = thread(ConvertSegmentsInBackground);
+		}
 
-			INodeMap& nodeMap = pCamList[i]->GetNodeMap();
-			CStringPtr ptrStringSerial = pCamList[i]->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
+		// START RECORDING
+		cout << endl << "*** START RECORDING ***" << endl << endl;
 
-			if (IsAvailable(ptrStringSerial) && IsReadable(ptrStringSerial))
-			{
-				serialNumber = ptrStringSerial->GetValue();
-			}
+		vector<thread> grabThreads;
+		vector<thread> writerThreads;
+		grabThreadsRunning = camListSize;
 
-			// Set DeviceUserID to loop counter to assign camera order to cameraFiles in oarallel threads
-			CStringPtr ptrDeviceUserId = nodeMap.GetNode("DeviceUserID");
-			if (!IsAvailable(ptrDeviceUserId) || !IsWritable(ptrDeviceUserId))
+		// A commit window is kept until the ring writers of all cameras have passed it
+		unsigned int writerSlots = 0;
+		for (CameraSession& session : sessions)
+		{
+			writerSlots = max(writerSlots, session.cameraCnt + 1);
+		}
+		commitWindows.Reset(writerSlots);
+		for (CameraSession& session : sessions)
+		{
+			if (useRings)
 			{
-				cout << "Unable to get node ptrDeviceUserId. Aborting..." << endl << endl;
-				return -1;
+				commitWindows.Join(session.cameraCnt);
 			}
+		}
 
-			stringstream sstreamDeviceUserID;
-			sstreamDeviceUserID << i;
-			string DeviceUserID = sstreamDeviceUserID.str();
-			ptrDeviceUserId->SetValue(DeviceUserID.c_str());
-			cameraCnt = atoi(DeviceUserID.c_str());
-
-			cout << endl << endl << "[" << serialNumber << "] " << "*** Camera Initialization ***" << " ID: [" << DeviceUserID << "]" << endl;
+		for (unsigned int i = 0; i < camListSize; i++)
+		{
+			// Start grab thread, call AcquireImages in parallel threads
+			CameraSession& session = sessions[i];
+			grabThreads.emplace_back([&session]()
+			{
+				session.grabResult = AcquireImages(session);
+				session.grabFinished = true;
+				grabThreadsRunning--;
+			});
 
-			if (serialNumber == triggerCam)  // primary camera defined in PARAMETERS
+			// Save frames from the pre-trigger ring or the frame queue
+			if (useRings)
 			{
-				ConfigureStrobe(pCamList[i], nodeMap);
-				chosenTrigger = SOFTWARE; // variable is changed globally
-				ConfigureTrigger(nodeMap); // primary camera will work in free running
+				writerThreads.emplace_back([&session]() { session.writerResult = WriteFramesFromRing(session); });
 			}
-			else // secondary cameras
+
+			// The latency sample is allocated once, so it never grows while recording
+			if (latencyBenchmark == 1)
 			{
-				chosenTrigger = HARDWARE; // variable is changed globally
-				ConfigureTrigger(nodeMap); // secondary cameras are triggered by primary camera
+				session.latency.Start();
 			}
+		}
 
-			// Set Buffer
-			BufferHandlingSettings(pCamList[i]);
-
-			// Set Strobe
-			ConfigureStrobe(pCamList[i], nodeMap);
-
-			// Set Exposure and Framerate
-			ConfigureExposure(nodeMap);
+		// Start barrier: all streams purged and all threads waiting before the primary camera starts triggering
+		startBarrier.WaitArrived(camListSize);
+		ReportThreadLayout(sessions);
+		const double cpuStart = ProcessCpuSeconds();
+		const auto recordingStart = steady_clock::now();
+		startBarrier.Start();
 
-			// Set Image Settings
-			ImageSettings(nodeMap);
+		// ESC is read from the console without Enter while recording
+		if (sessionMode == 0)
+		{
+			CaptureKeyboard(true);
+		}
 
-			// Create binary files for each camera and overall .csv logfile
-			CreateFiles(serialNumber, cameraCnt);
+		// Secondary machines report armed cameras, the primary waits for all of them before triggering
+		thread flushThread;
+		thread watchThread;
+		if (coordinated)
+		{
+			flushThread = thread(FlushCoordinatorLog);
+		}
+		if (role == "secondary")
+		{
+			SendLine(coordinatorSocket, "READY");
+			watchThread = thread(WatchPrimary);
+		}
+		else if (role == "primary" && WaitForSecondaries() != 0)
+		{
+			stopRecording = true;
+		}
 
-			pCamList[i]->DeInit();
+		// Accept commands from experiment software
+		thread controlThread;
+		if (!controlChannel.empty())
+		{
+			controlThread = thread(ControlServer, std::ref(sessions));
 		}
-	}
-	catch (Spinnaker::Exception& e)
-	{
-		cout << "Error: " << e.what() << endl;
-		result = -1;
-	}
-	return result;
-}
 
-/*
-=================
-The function RecordMultipleCameraThreads acts as the body of the program. It calls the InitializeMultipleCameras function to configure all cameras, then creates parallel threads and starts AcquireImages on each thred. With the setting configured above, threads are waiting for synchronized trigger as a central clock.
-=================
-*/
-int RecordMultipleCameraThreads(CameraList camList)
-{
-	int result = 0;
-	unsigned int camListSize = 0;
+		// Trials are started and stopped by commands, cameras stay armed in between
+		thread consoleThread;
+		if (sessionMode == 1)
+		{
+			consoleThread = thread(RunSession, std::ref(sessions));
+		}
+		else if (!stopRecording)
+		{
+			StartPrimaryTrigger(sessions);
+			trialRunning = true;
+			cout << "Press ESC to stop recording" << endl;
+		}
 
-	try
-	{
-		// Retrieve camera list size
-		camListSize = camList.GetSize();
+		// Wait for all threads to finish, ESC is polled here and not in the grab loops
+		while (grabThreadsRunning > 0)
+		{
+			this_thread::sleep_for(milliseconds(50));
+			if (sessionMode == 0 && !stopRecording && EscapePressed())
+			{
+				stopRecording = true;
+				cout << "Recording stopped by ESC" << endl;
+			}
 
-		// Create an array of handles
-		CameraPtr* pCamList = new CameraPtr[camListSize];
+			// Drop consumers that fell behind and tell the grab threads whether anyone is attached
+			if (fanoutMemory.base != nullptr)
+			{
+				uint32_t active = CheckConsumers(fanoutMemory.base);
+				if (active != fanoutActive)
+				{
+					cout << "Frame consumers attached: " << active << endl;
+					fanoutActive = active;
+				}
+			}
+		}
+		stopRecording = true;
+		trialRunning = false;
+		CaptureKeyboard(false);
+		if (consoleThread.joinable())
+		{
+			consoleThread.join();
+		}
+		for (thread& grabThread : grabThreads)
+		{
+			grabThread.join();
+		}
 
-		// Initialize cameras in camList 
-		InitializeMultipleCameras(camList, pCamList, camListSize);
+		// Ring writers save the frames of the last commit window and close the files
+		for (thread& writerThread : writerThreads)
+		{
+			writerThread.join();
+		}
 
-		// START RECORDING
-		cout << endl << "*** START RECORDING ***" << endl << endl;
+		ReportGrabJitter(sessions);
+		ReportAcquisitionBenchmark(sessions, ProcessCpuSeconds() - cpuStart, duration<double>(steady_clock::now() - recordingStart).count());
 
-		HANDLE* grabThreads = new HANDLE[camListSize];
-		for (unsigned int i = 0; i < camListSize; i++)
+		if (activityGate.frames > 0)
 		{
-			// Start grab thread
-			grabThreads[i] = CreateThread(nullptr, 0, AcquireImages, &pCamList[i], 0, nullptr); // call AcquireImages in parallel threads
-			assert(grabThreads[i] != nullptr);
+			cout << "Activity gate opened " << activityGate.activations << " times, " << activityGate.totalMs / activityGate.frames
+				<< " ms per frame on average, " << activityGate.maxMs << " ms at most (frame period " << 1000.0 / NewFrameRate << " ms)" << endl;
 		}
 
-		// Wait for all threads to finish
-		WaitForMultipleObjects(
-			camListSize, // number of threads to wait for
-			grabThreads, // handles for threads to wait for
-			TRUE,        // wait for all of the threads
-			INFINITE     // wait forever
-		);
+		if (controlThread.joinable())
+		{
+			StopControlServer(controlThread);
+		}
 
-		CloseHandle(ghMutex);
+		// Send the last log records, then stop the secondary machines and close the session index
+		if (flushThread.joinable())
+		{
+			coordinatorFlushDone = true;
+			flushThread.join();
+		}
+		if (role == "primary")
+		{
+			StopSecondaries();
+		}
+		else if (role == "secondary")
+		{
+			SendLine(coordinatorSocket, "DONE");
+			shutdown(coordinatorSocket, 2); // SD_BOTH, SHUT_RDWR
+			watchThread.join();
+			CloseSocket(coordinatorSocket);
+		}
 
 		// Check thread return code for each camera
 		for (unsigned int i = 0; i < camListSize; i++)
 		{
-			DWORD exitcode;
-			BOOL rc = GetExitCodeThread(grabThreads[i], &exitcode);
-			if (!rc)
+			if (!sessions[i].grabResult)
 			{
-				cout << "Handle error from GetExitCodeThread() returned for camera at index " << i << endl;
+				cout << "Grab thread for camera at index " << i << " exited with errors." << endl;
 				result = -1;
 			}
-			else if (!exitcode)
+			if (!sessions[i].writerResult)
 			{
-				cout << "Grab thread for camera at index " << i << " exited with errors." << endl;
+				cout << "Writer thread for camera at index " << i << " exited with errors." << endl;
 				result = -1;
 			}
 		}
 
-		// Clear CameraPtr array and close all handles
-		for (unsigned int i = 0; i < camListSize; i++)
+		csvFile.close();
+		eventsFile.close();
+
+		// Deinitialize all cameras
+		CloseCameraSessions(sessions);
+		CloseSharedMemory(previewMemory, true);
+		if (fanoutMemory.base != nullptr)
 		{
-			pCamList[i] = 0;
-			CloseHandle(grabThreads[i]);
+			ReportConsumers();
+			CloseSharedMemory(fanoutMemory, true);
 		}
 
-		// Delete array pointer
-		delete[] pCamList;
-
-		// Delete array pointer
-		delete[] grabThreads;
-
 		// End of recording
 		cout << endl << "*** STOP RECORDING ***" << endl << endl;
+
+		// Convert remaining segments
+		if (converterThread.joinable())
+		{
+			recordingDone = true;
+			cout << "Waiting for background conversion of remaining segments..." << endl;
+			converterThread.join();
+		}
 	}
 	catch (Spinnaker::Exception& e)
 	{
@@ -972,6 +4741,13 @@ int main(int /*argc*/, char** /*argv*/)
 	// Read config file and update parameters
 	readconfig();
 
+	// Streaming to a storage node and coordinated machines need sockets
+	if ((!sinkHost.empty() || role != "standalone") && !StartSockets())
+	{
+		cout << "Unable to start sockets" << endl;
+		return -1;
+	}
+
 	// Retrieve singleton reference to system object
 	SystemPtr system = System::GetInstance();
 
@@ -982,6 +4758,12 @@ int main(int /*argc*/, char** /*argv*/)
 	// Retrieve list of cameras from the system
 	CameraList camList = system->GetCameras();
 
+	// Host controller of each camera for the bandwidth planner
+	if (controllerBandwidth > 0)
+	{
+		ReadCameraInterfaces(system);
+	}
+
 	unsigned int numCameras = camList.GetSize();
 
 	cout << "Number of cameras detected: " << numCameras << endl;
@@ -1002,35 +4784,9 @@ int main(int /*argc*/, char** /*argv*/)
 		return -1;
 	}
 
-	// Create mutex to lock parallel threads
-	ghMutex = CreateMutex(
-		NULL,              // default security attributes
-		FALSE,             // initially not owned
-		NULL);             // unnamed mutex
-
-	if (ghMutex == NULL)
-	{
-		printf("CreateMutex error: %d\n", GetLastError());
-		return 1;
-	}
-
 	// Run all cameras
 	result = RecordMultipleCameraThreads(camList);
 
-	// Save metadata with recording settings
-	cout << endl << "Metadata file: " << metadataFilename << " saved in " << path << endl << endl;
-
-	metadataFile.open(metadataFilename);
-	metadataFile << "# This is the metadata summarizing recording parameters" << endl;
-	metadataFile << "Filename=" << metadataFilename << endl;
-	metadataFile << "Framerate=" << NewFrameRate << endl;
-	metadataFile << "ImageHeight=" << heightToSet << endl;
-	metadataFile << "ImageWidth=" << widthToSet << endl;
-	metadataFile << "# Change ColorVideo = 1/0, chosenVideoType =UNCOMPRESSED/MJPG/H264 and VideoPath" << endl;
-	metadataFile << "ColorVideo=1" << endl;
-	metadataFile << "chosenVideoType=UNCOMPRESSED" << endl;
-	metadataFile << "VideoPath=" << path << endl;
-
 	// Clear camera list before releasing system
 	camList.Clear();
 
@@ -0,0 +1,460 @@
+/*
+====================================================================================================
+This header defines the shared memory layout in which RECtoBIN publishes frames to other local
+processes, e.g. a live viewer or a tracking tool. One region holds a header, a table with one entry
+per camera and a ring of slots per camera. Each slot starts with a seqlock sequence number that is
+odd while the recorder writes the slot, so readers never block the recorder and detect torn frames
+by comparing the sequence before and after reading. Readers include this header and use
+OpenSharedMemory and ReadLatestFrame. Regions with a consumer table also carry every frame to
+consumers that must not miss any, each consumer follows its own cursor per camera with
+AttachConsumer, NextFrame and ReleaseFrame. The recorder never waits for a consumer and drops
+consumers that fall a whole ring behind.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const uint32_t SHARED_FRAMES_MAGIC = 0x52464C46; // "FLFR"
+const uint32_t SHARED_FRAMES_VERSION = 2;
+
+enum sharedConsumerState
+{
+	CONSUMER_FREE,
+	CONSUMER_ACTIVE,
+	CONSUMER_DROPPED // fell a whole ring behind, detach and attach again
+};
+
+struct SharedFramesHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t cameras;
+	uint32_t slots; // slots per camera
+	uint64_t slotStride; // bytes per slot including the SharedSlot record
+	uint64_t dataBytes; // maximum pixel bytes per slot
+	uint32_t consumers; // entries in the consumer table, 0 = latest frame readers only
+	uint32_t cursorStride; // bytes per consumer in the cursor table
+	uint64_t reserved[3];
+};
+
+struct SharedCamera
+{
+	char serialNumber[32];
+	std::atomic<uint64_t> published; // frames published, the newest is in slot (published - 1) % slots
+	uint64_t reserved[3];
+};
+
+struct SharedSlot
+{
+	std::atomic<uint32_t> sequence; // odd while the slot is written
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels; // 1 = Mono8, 3 = BGR8
+	uint64_t frameID;
+	uint64_t timestamp; // camera timestamp in nanoseconds
+	uint64_t size; // pixel bytes following the record
+	uint64_t reserved[3];
+};
+
+struct SharedConsumer
+{
+	std::atomic<uint32_t> state;
+	uint32_t processID;
+	std::atomic<uint64_t> maxLag; // largest number of frames behind, updated by the recorder
+	std::atomic<uint64_t> frames; // frames released by the consumer, read by the recorder
+	uint64_t reserved[5];
+};
+
+static_assert(sizeof(SharedFramesHeader) == 64 && sizeof(SharedCamera) == 64 && sizeof(SharedSlot) == 64 && sizeof(SharedConsumer) == 64, "shared frame records are one cache line each");
+
+/*
+=================
+The functions SharedFramesSize, SharedCameraAt, SharedConsumerAt, SharedCursorAt, SharedSlotAt and SharedPixels compute the size of a region and the position of its records. The camera table is followed by the consumer table, the cursor table and the slots. All records are 64 bytes and every consumer has its own cursor cache lines, so pixel data starts on a cache line and consumers do not share lines.
+=================
+*/
+inline uint64_t SharedSlotStride(uint64_t dataBytes)
+{
+	return sizeof(SharedSlot) + ((dataBytes + 63) / 64) * 64;
+}
+
+inline uint32_t SharedCursorStride(uint32_t cameras)
+{
+	return ((cameras * (uint32_t)sizeof(uint64_t) + 63) / 64) * 64;
+}
+
+inline uint64_t SharedTablesSize(uint32_t cameras, uint32_t consumers)
+{
+	return sizeof(SharedFramesHeader) + (uint64_t)cameras * sizeof(SharedCamera) + (uint64_t)consumers * (sizeof(SharedConsumer) + SharedCursorStride(cameras));
+}
+
+inline uint64_t SharedFramesSize(uint32_t cameras, uint32_t slots, uint64_t dataBytes, uint32_t consumers = 0)
+{
+	return SharedTablesSize(cameras, consumers) + (uint64_t)cameras * slots * SharedSlotStride(dataBytes);
+}
+
+inline SharedCamera* SharedCameraAt(uint8_t* base, uint32_t camera)
+{
+	return reinterpret_cast<SharedCamera*>(base + sizeof(SharedFramesHeader) + (uint64_t)camera * sizeof(SharedCamera));
+}
+
+inline SharedConsumer* SharedConsumerAt(uint8_t* base, uint32_t consumer)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	uint64_t offset = sizeof(SharedFramesHeader) + (uint64_t)header->cameras * sizeof(SharedCamera) + (uint64_t)consumer * sizeof(SharedConsumer);
+	return reinterpret_cast<SharedConsumer*>(base + offset);
+}
+
+inline std::atomic<uint64_t>* SharedCursorAt(uint8_t* base, uint32_t consumer, uint32_t camera)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	uint64_t offset = sizeof(SharedFramesHeader) + (uint64_t)header->cameras * sizeof(SharedCamera) + (uint64_t)header->consumers * sizeof(SharedConsumer)
+		+ (uint64_t)consumer * header->cursorStride + camera * sizeof(uint64_t);
+	return reinterpret_cast<std::atomic<uint64_t>*>(base + offset);
+}
+
+inline SharedSlot* SharedSlotAt(uint8_t* base, uint32_t camera, uint64_t slot)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	uint64_t offset = SharedTablesSize(header->cameras, header->consumers) + ((uint64_t)camera * header->slots + slot) * header->slotStride;
+	return reinterpret_cast<SharedSlot*>(base + offset);
+}
+
+inline uint8_t* SharedPixels(SharedSlot* slot)
+{
+	return reinterpret_cast<uint8_t*>(slot) + sizeof(SharedSlot);
+}
+
+/*
+=================
+The struct SharedMemory holds one mapped region. The function CreateSharedMemory creates and maps a named region for the recorder, OpenSharedMemory maps an existing one for readers and CloseSharedMemory unmaps it again, the owner also removes the name. Names are plain words, e.g. syncFLIR_preview.
+=================
+*/
+struct SharedMemory
+{
+	uint8_t* base = nullptr;
+	uint64_t size = 0;
+	std::string name;
+#if defined(_WIN32)
+	HANDLE mapping = nullptr;
+#endif
+};
+
+inline bool MapSharedMemory(SharedMemory& shm, const std::string& name, uint64_t size, bool create)
+{
+	shm.name = name;
+#if defined(_WIN32)
+	std::string objectName = "Local\\" + name;
+	if (create)
+	{
+		shm.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), objectName.c_str());
+	}
+	else
+	{
+		shm.mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, objectName.c_str());
+	}
+	if (shm.mapping == NULL)
+	{
+		return false;
+	}
+	shm.base = static_cast<uint8_t*>(MapViewOfFile(shm.mapping, FILE_MAP_ALL_ACCESS, 0, 0, (size_t)size));
+	if (shm.base == nullptr)
+	{
+		CloseHandle(shm.mapping);
+		shm.mapping = nullptr;
+		return false;
+	}
+#else
+	std::string objectName = "/" + name;
+	int fd = shm_open(objectName.c_str(), create ? (O_CREAT | O_RDWR) : O_RDWR, 0600);
+	if (fd < 0)
+	{
+		return false;
+	}
+	if (create && ftruncate(fd, (off_t)size) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	if (!create)
+	{
+		struct stat info;
+		fstat(fd, &info);
+		size = (uint64_t)info.st_size;
+	}
+	void* mapped = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		return false;
+	}
+	shm.base = static_cast<uint8_t*>(mapped);
+#endif
+	shm.size = size;
+	return true;
+}
+
+inline bool CreateSharedMemory(SharedMemory& shm, const std::string& name, uint64_t size)
+{
+	return MapSharedMemory(shm, name, size, true);
+}
+
+inline bool OpenSharedMemory(SharedMemory& shm, const std::string& name, uint64_t size = 0)
+{
+	// size 0 maps the whole region on POSIX and the whole view on Windows
+	return MapSharedMemory(shm, name, size, false);
+}
+
+inline void CloseSharedMemory(SharedMemory& shm, bool owner)
+{
+	if (shm.base == nullptr)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	UnmapViewOfFile(shm.base);
+	CloseHandle(shm.mapping);
+	shm.mapping = nullptr;
+#else
+	munmap(shm.base, (size_t)shm.size);
+	if (owner)
+	{
+		shm_unlink(("/" + shm.name).c_str());
+	}
+#endif
+	shm.base = nullptr;
+}
+
+/*
+=================
+The function InitSharedFrames writes the header, camera and consumer table of a new region. BeginSharedFrame returns the next slot of a camera with its sequence made odd, the recorder fills record and pixels in place and calls EndSharedFrame to make the slot even again and publish it. Both never wait.
+=================
+*/
+inline void InitSharedFrames(uint8_t* base, const std::vector<std::string>& serialNumbers, uint32_t slots, uint64_t dataBytes, uint32_t consumers = 0)
+{
+	uint32_t cameras = (uint32_t)serialNumbers.size();
+	memset(base, 0, (size_t)SharedFramesSize(cameras, slots, dataBytes, consumers));
+
+	SharedFramesHeader* header = reinterpret_cast<SharedFramesHeader*>(base);
+	header->version = SHARED_FRAMES_VERSION;
+	header->cameras = cameras;
+	header->slots = slots;
+	header->slotStride = SharedSlotStride(dataBytes);
+	header->dataBytes = dataBytes;
+	header->consumers = consumers;
+	header->cursorStride = SharedCursorStride(cameras);
+
+	for (uint32_t i = 0; i < cameras; i++)
+	{
+		strncpy(SharedCameraAt(base, i)->serialNumber, serialNumbers[i].c_str(), sizeof(SharedCamera::serialNumber) - 1);
+	}
+
+	// Readers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = SHARED_FRAMES_MAGIC;
+}
+
+inline SharedSlot* BeginSharedFrame(uint8_t* base, uint32_t camera)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	uint64_t next = SharedCameraAt(base, camera)->published.load(std::memory_order_relaxed);
+	SharedSlot* slot = SharedSlotAt(base, camera, next % header->slots);
+
+	slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	return slot;
+}
+
+inline void EndSharedFrame(uint8_t* base, uint32_t camera, SharedSlot* slot)
+{
+	slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	SharedCameraAt(base, camera)->published.fetch_add(1, std::memory_order_release);
+}
+
+/*
+=================
+The function ReadLatestFrame copies the newest frame of a camera into pixels. It returns false if nothing was published yet or the recorder overwrote the slot while it was copied, the reader simply tries again. Readers that want to avoid the copy can process SharedPixels in place and check the sequence afterwards in the same way.
+=================
+*/
+inline bool ReadLatestFrame(uint8_t* base, uint32_t camera, SharedSlot& record, std::vector<uint8_t>& pixels)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	if (header->magic != SHARED_FRAMES_MAGIC || camera >= header->cameras)
+	{
+		return false;
+	}
+
+	uint64_t published = SharedCameraAt(base, camera)->published.load(std::memory_order_acquire);
+	if (published == 0)
+	{
+		return false;
+	}
+
+	SharedSlot* slot = SharedSlotAt(base, camera, (published - 1) % header->slots);
+	uint32_t before = slot->sequence.load(std::memory_order_acquire);
+	if (before & 1)
+	{
+		return false;
+	}
+
+	record.width = slot->width;
+	record.height = slot->height;
+	record.channels = slot->channels;
+	record.frameID = slot->frameID;
+	record.timestamp = slot->timestamp;
+	record.size = slot->size;
+	if (record.size > header->dataBytes)
+	{
+		return false;
+	}
+	pixels.resize((size_t)record.size);
+	memcpy(pixels.data(), SharedPixels(slot), (size_t)record.size);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot->sequence.load(std::memory_order_relaxed) == before;
+}
+
+/*
+=================
+The function AttachConsumer claims a free entry of the consumer table and starts all its cursors at the next frame to be published, it returns the consumer index or -1 if the table is full. DetachConsumer frees the entry again, also after the consumer was dropped.
+=================
+*/
+inline int AttachConsumer(uint8_t* base, uint32_t processID)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	if (header->magic != SHARED_FRAMES_MAGIC)
+	{
+		return -1;
+	}
+
+	for (uint32_t consumer = 0; consumer < header->consumers; consumer++)
+	{
+		SharedConsumer* entry = SharedConsumerAt(base, consumer);
+		uint32_t expected = CONSUMER_FREE;
+		if (!entry->state.compare_exchange_strong(expected, CONSUMER_ACTIVE))
+		{
+			continue;
+		}
+
+		entry->processID = processID;
+		entry->maxLag = 0;
+		entry->frames.store(0, std::memory_order_relaxed);
+		for (uint32_t camera = 0; camera < header->cameras; camera++)
+		{
+			SharedCursorAt(base, consumer, camera)->store(SharedCameraAt(base, camera)->published.load(std::memory_order_acquire), std::memory_order_release);
+		}
+		return (int)consumer;
+	}
+	return -1;
+}
+
+inline void DetachConsumer(uint8_t* base, uint32_t consumer)
+{
+	SharedConsumerAt(base, consumer)->state.store(CONSUMER_FREE, std::memory_order_release);
+}
+
+/*
+=================
+The function NextFrame gives a consumer the next frame of a camera in place, without copying. It returns nullptr if no new frame is published yet or the consumer was dropped. After processing, ReleaseFrame moves the cursor on and returns false if the recorder overwrote the frame in the meantime. Frame n is the (n / slots + 1)th write of its slot, so its sequence number is known in advance.
+=================
+*/
+inline uint32_t ExpectedSequence(const SharedFramesHeader* header, uint64_t frame)
+{
+	return (uint32_t)(2 * (frame / header->slots + 1));
+}
+
+inline const uint8_t* NextFrame(uint8_t* base, uint32_t consumer, uint32_t camera, SharedSlot*& slot)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	if (SharedConsumerAt(base, consumer)->state.load(std::memory_order_acquire) != CONSUMER_ACTIVE)
+	{
+		return nullptr;
+	}
+
+	uint64_t cursor = SharedCursorAt(base, consumer, camera)->load(std::memory_order_relaxed);
+	if (cursor >= SharedCameraAt(base, camera)->published.load(std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+
+	slot = SharedSlotAt(base, camera, cursor % header->slots);
+	if (slot->sequence.load(std::memory_order_acquire) != ExpectedSequence(header, cursor))
+	{
+		return nullptr;
+	}
+	return SharedPixels(slot);
+}
+
+inline bool ReleaseFrame(uint8_t* base, uint32_t consumer, uint32_t camera, SharedSlot* slot)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	std::atomic<uint64_t>* cursor = SharedCursorAt(base, consumer, camera);
+	uint64_t frame = cursor->load(std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	bool intact = slot->sequence.load(std::memory_order_relaxed) == ExpectedSequence(header, frame);
+
+	cursor->store(frame + 1, std::memory_order_release);
+	SharedConsumerAt(base, consumer)->frames.fetch_add(1, std::memory_order_relaxed);
+	return intact;
+}
+
+/*
+=================
+The function CheckConsumers is called by the recorder from time to time. It updates the lag statistics of all active consumers and drops those that are a whole ring behind, their next frame is already being overwritten. It returns the number of active consumers, so the recorder can skip copying frames while nobody is attached.
+=================
+*/
+inline uint32_t CheckConsumers(uint8_t* base)
+{
+	const SharedFramesHeader* header = reinterpret_cast<const SharedFramesHeader*>(base);
+	uint32_t active = 0;
+
+	for (uint32_t consumer = 0; consumer < header->consumers; consumer++)
+	{
+		SharedConsumer* entry = SharedConsumerAt(base, consumer);
+		if (entry->state.load(std::memory_order_acquire) != CONSUMER_ACTIVE)
+		{
+			continue;
+		}
+
+		uint64_t lag = 0;
+		for (uint32_t camera = 0; camera < header->cameras; camera++)
+		{
+			uint64_t published = SharedCameraAt(base, camera)->published.load(std::memory_order_acquire);
+			uint64_t cursor = SharedCursorAt(base, consumer, camera)->load(std::memory_order_acquire);
+			lag = (published > cursor) ? std::max(lag, published - cursor) : lag;
+		}
+		if (lag > entry->maxLag)
+		{
+			entry->maxLag = lag;
+		}
+
+		if (lag >= header->slots)
+		{
+			uint32_t expected = CONSUMER_ACTIVE;
+			entry->state.compare_exchange_strong(expected, CONSUMER_DROPPED);
+			continue;
+		}
+		active++;
+	}
+	return active;
+}
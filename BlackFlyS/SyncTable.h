@@ -0,0 +1,624 @@
+/*
+====================================================================================================
+This header contains the cross-camera frame alignment shared by the syncFLIR tools. All cameras are
+triggered by the pulses of the primary camera, so every pulse is one session frame. SyncTable reads
+the FrameID and Timestamp records of all cameras in one streaming pass over the csv logfile of
+RECtoBIN or the session index of a coordinated recording, and places each frame on its session frame:
+FrameID steps count trigger pulses, camera timestamps confirm them, and the first frame of every
+camera is anchored to the first camera by its FrameID distance, checked against the system time.
+Only a short window of session frames is kept in memory, so sessions with tens of millions of records
+are aligned in constant memory.
+The result is a table session frame -> position of the frame in the binary file of each camera, or
+SYNC_MISSING. Every trial has its own binary files, so a table always covers one trial. LOGtoSYNC
+saves it as a .sync file, BINtoAVI uses it to re-time and tile videos. A .sync file is a
+SyncTableHeader, cameras x 32 byte serial numbers and frames rows of cameras int32 positions followed
+by cameras uint64 FrameIDs.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <functional>
+#include <algorithm>
+
+const uint32_t SYNC_MAGIC = 0x434E5953; // "SYNC"
+const uint32_t SYNC_VERSION = 2;
+const int32_t SYNC_MISSING = -1;
+const size_t SYNC_SERIAL_SIZE = 32;
+const double SYNC_ANCHOR_TOLERANCE_NS = 50e6; // FrameID and system time must agree within this to anchor by FrameID
+
+struct SyncTableHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t cameras;
+	uint32_t trial; // trial of the table, 0 = unknown
+	uint64_t frames;
+	double frameRate;
+};
+
+static_assert(sizeof(SyncTableHeader) == 32, "SyncTableHeader is saved as is");
+
+struct SyncRecord
+{
+	uint64_t frameID;
+	uint64_t timestamp; // camera clock in nanoseconds
+	int64_t systemTime; // host clock in nanoseconds, 0 if not logged
+	int camera; // column in the table
+};
+
+/*
+=================
+The struct SyncCamera holds the alignment state and the statistics of one camera. periodNs is the trigger period measured by the camera clock, jitter is the deviation of single frame intervals from it. skew compares the system time of each frame with the first camera of the table on the same session frame, i.e. the spread of arrival on the host.
+=================
+*/
+struct SyncCamera
+{
+	std::string serial;
+
+	bool seen = false;
+	int64_t lastSlot = 0;
+	uint64_t lastFrameID = 0;
+	uint64_t lastTimestamp = 0;
+	int32_t nextOffset = 0; // position of the next frame in the binary file
+	double periodNs = 0;
+
+	uint64_t frames = 0;
+	uint64_t aligned = 0;
+	uint64_t missing = 0;
+	uint64_t dropped = 0; // duplicate session frames, kept out of the table
+	uint64_t idMismatches = 0; // FrameID steps contradicted by the timestamps
+
+	uint64_t intervals = 0;
+	double jitterSumNs = 0;
+	double jitterMaxNs = 0;
+
+	uint64_t skewCount = 0;
+	double skewSumNs = 0;
+	double skewSquareSumNs = 0;
+	double skewMaxNs = 0;
+};
+
+/*
+=================
+The struct SyncTable aligns the records passed to Add and hands every finished session frame to emit, in order and exactly once. All cameras count the same trigger pulses, so the first frame of a camera is placed by its FrameID distance to the first frame of the first camera, and a camera that missed the first pulse starts on session frame 1. If the system time of the first frames contradicts the FrameID distance, e.g. after a FrameID reset, the system time places it. A session frame is finished once every camera has moved past it. Until all cameras have been seen the window grows at the front as well, so cameras that started before the first logged one get negative raw slots and session frame 0 is the earliest frame of any camera. The window holds at most maxPending session frames, a camera that stops recording can not stall the others. Finish emits the rest.
+=================
+*/
+struct SyncTable
+{
+	std::vector<SyncCamera> cameras;
+	double frameRate = 0;
+	uint32_t trial = 0; // saved in the header, see SyncTrialNumber
+	std::function<void(int64_t sessionFrame, const int32_t* offsets, const uint64_t* frameIDs)> emit;
+	int64_t framesEmitted = 0;
+	uint64_t lateRecords = 0; // records for session frames that were already emitted
+	size_t maxPending = 1 << 16;
+
+	void Init(const std::vector<std::string>& serials, double framesPerSecond)
+	{
+		cameras.assign(serials.size(), SyncCamera());
+		for (size_t c = 0; c < serials.size(); c++)
+		{
+			cameras[c].serial = serials[c];
+		}
+		frameRate = framesPerSecond;
+		nominalPeriodNs = 1e9 / framesPerSecond;
+		width = serials.size();
+		offsets.assign(maxPending * width, SYNC_MISSING);
+		frameIDs.assign(maxPending * width, 0);
+		systemTimes.assign(maxPending * width, 0);
+	}
+
+	void Add(const SyncRecord& record)
+	{
+		SyncCamera& camera = cameras[record.camera];
+		int32_t offset = camera.nextOffset++;
+		camera.frames++;
+
+		int64_t slot;
+		if (!camera.seen)
+		{
+			// The first camera starts at raw slot 0, the others are anchored to it by FrameID or system time
+			camera.seen = true;
+			camera.periodNs = nominalPeriodNs;
+			if (camerasSeen++ == 0)
+			{
+				referenceTime = record.systemTime;
+				referenceFrameID = record.frameID;
+				slot = 0;
+			}
+			else
+			{
+				slot = (int64_t)(record.frameID - referenceFrameID);
+				if (record.systemTime != 0 && referenceTime != 0)
+				{
+					double timeSlots = (double)(record.systemTime - referenceTime) / nominalPeriodNs;
+					if (std::fabs(timeSlots - slot) * nominalPeriodNs > std::max(SYNC_ANCHOR_TOLERANCE_NS, 2 * nominalPeriodNs))
+					{
+						slot = llround(timeSlots);
+					}
+				}
+			}
+		}
+		else
+		{
+			int64_t idSteps = (int64_t)(record.frameID - camera.lastFrameID);
+			double interval = (double)(int64_t)(record.timestamp - camera.lastTimestamp);
+			int64_t timeSteps = llround(interval / camera.periodNs);
+
+			// FrameID counts pulses exactly, timestamps catch missed triggers and FrameID resets within 500 ppm
+			int64_t steps = idSteps;
+			if (idSteps <= 0 || std::llabs(idSteps - timeSteps) > timeSteps / 2000)
+			{
+				camera.idMismatches++;
+				steps = timeSteps;
+			}
+			if (steps <= 0)
+			{
+				camera.dropped++;
+				return;
+			}
+			if (idSteps == 1 && timeSteps == 1)
+			{
+				double jitter = std::fabs(interval - camera.periodNs);
+				camera.intervals++;
+				camera.jitterSumNs += jitter;
+				camera.jitterMaxNs = std::max(camera.jitterMaxNs, jitter);
+				camera.periodNs += (interval - camera.periodNs) / 256;
+			}
+			slot = camera.lastSlot + steps;
+		}
+		camera.lastSlot = slot;
+		camera.lastFrameID = record.frameID;
+		camera.lastTimestamp = record.timestamp;
+
+		if (!Place(slot, record, offset))
+		{
+			camera.dropped++;
+		}
+		Drain(false);
+	}
+
+	void Finish()
+	{
+		Drain(true);
+	}
+
+private:
+	bool Place(int64_t slot, const SyncRecord& record, int32_t offset)
+	{
+		if (rows == 0 && !started)
+		{
+			pendingBase = slot;
+		}
+
+		if (slot < pendingBase)
+		{
+			if (started)
+			{
+				lateRecords++;
+				return false;
+			}
+			// Grow at the front until all cameras are seen
+			while (slot < pendingBase && rows < maxPending)
+			{
+				head = (head + maxPending - 1) % maxPending;
+				ClearRow(head);
+				pendingBase--;
+				rows++;
+			}
+			if (slot < pendingBase)
+			{
+				lateRecords++;
+				return false;
+			}
+		}
+
+		while ((size_t)(slot - pendingBase) >= rows)
+		{
+			if (rows == maxPending)
+			{
+				// A camera fell silent, emit without it
+				Start();
+				EmitFront();
+				continue;
+			}
+			ClearRow((head + rows) % maxPending);
+			rows++;
+		}
+
+		size_t cell = ((head + (size_t)(slot - pendingBase)) % maxPending) * width + record.camera;
+		if (offsets[cell] != SYNC_MISSING)
+		{
+			return false;
+		}
+		offsets[cell] = offset;
+		frameIDs[cell] = record.frameID;
+		systemTimes[cell] = record.systemTime;
+		return true;
+	}
+
+	void Drain(bool all)
+	{
+		if (!all && camerasSeen < cameras.size())
+		{
+			return;
+		}
+		Start();
+
+		int64_t finished = INT64_MAX;
+		for (const SyncCamera& camera : cameras)
+		{
+			if (camera.seen)
+			{
+				finished = std::min(finished, camera.lastSlot);
+			}
+		}
+		while (rows > 0 && (all || pendingBase < finished))
+		{
+			EmitFront();
+		}
+	}
+
+	void Start()
+	{
+		if (!started)
+		{
+			started = true;
+			origin = pendingBase;
+		}
+	}
+
+	void EmitFront()
+	{
+		size_t row = head * width;
+
+		// Arrival skew against the first camera of the table
+		int64_t referenceSystemTime = (offsets[row] != SYNC_MISSING) ? systemTimes[row] : 0;
+		for (size_t c = 0; c < width; c++)
+		{
+			SyncCamera& camera = cameras[c];
+			if (offsets[row + c] == SYNC_MISSING)
+			{
+				camera.missing++;
+				continue;
+			}
+			camera.aligned++;
+			if (c > 0 && referenceSystemTime != 0 && systemTimes[row + c] != 0)
+			{
+				double skew = (double)(systemTimes[row + c] - referenceSystemTime);
+				camera.skewCount++;
+				camera.skewSumNs += skew;
+				camera.skewSquareSumNs += skew * skew;
+				camera.skewMaxNs = std::max(camera.skewMaxNs, std::fabs(skew));
+			}
+		}
+
+		if (emit)
+		{
+			emit(pendingBase - origin, &offsets[row], &frameIDs[row]);
+		}
+		framesEmitted++;
+
+		head = (head + 1) % maxPending;
+		pendingBase++;
+		rows--;
+	}
+
+	void ClearRow(size_t row)
+	{
+		std::fill(offsets.begin() + row * width, offsets.begin() + (row + 1) * width, SYNC_MISSING);
+		std::fill(frameIDs.begin() + row * width, frameIDs.begin() + (row + 1) * width, 0);
+		std::fill(systemTimes.begin() + row * width, systemTimes.begin() + (row + 1) * width, 0);
+	}
+
+	// Ring of pending session frames, width entries per row
+	std::vector<int32_t> offsets;
+	std::vector<uint64_t> frameIDs;
+	std::vector<int64_t> systemTimes;
+	size_t width = 0;
+	size_t head = 0;
+	size_t rows = 0;
+	int64_t pendingBase = 0; // raw slot of the row at head
+	int64_t origin = 0; // raw slot of session frame 0
+	bool started = false;
+	size_t camerasSeen = 0;
+	int64_t referenceTime = 0;
+	uint64_t referenceFrameID = 0;
+	double nominalPeriodNs = 0;
+};
+
+/*
+=================
+The function ParseSyncRow splits one row of the csv logfile (FrameID,Timestamp,SerialNumber,FileNumber,SystemTimeInNanoseconds,Trial) or of the session index, which starts with a Machine column. It points into line instead of copying fields, as it runs for every record of a session.
+=================
+*/
+struct SyncRow
+{
+	uint64_t frameID;
+	uint64_t timestamp;
+	const char* serial;
+	size_t serialSize;
+	int64_t systemTime;
+	const char* trial;
+	size_t trialSize;
+};
+
+inline bool ParseSyncRow(const std::string& line, bool machineColumn, SyncRow& row)
+{
+	const char* fields[7];
+	size_t sizes[7];
+	size_t count = 0;
+	const char* start = line.c_str();
+	const char* end = start + line.size();
+	while (count < 7)
+	{
+		const char* comma = static_cast<const char*>(memchr(start, ',', end - start));
+		const char* fieldEnd = comma != nullptr ? comma : end;
+		fields[count] = start;
+		sizes[count] = fieldEnd - start;
+		count++;
+		if (comma == nullptr)
+		{
+			break;
+		}
+		start = comma + 1;
+	}
+
+	size_t first = machineColumn ? 1 : 0;
+	if (count < first + 3 || sizes[first] == 0 || sizes[first + 1] == 0)
+	{
+		return false;
+	}
+	row.frameID = strtoull(fields[first], nullptr, 10);
+	row.timestamp = strtoull(fields[first + 1], nullptr, 10);
+	row.serial = fields[first + 2];
+	row.serialSize = sizes[first + 2];
+	row.systemTime = (count > first + 4) ? strtoll(fields[first + 4], nullptr, 10) : 0;
+	row.trial = (count > first + 5) ? fields[first + 5] : "";
+	row.trialSize = (count > first + 5) ? sizes[first + 5] : 0;
+
+	// strip the line ending of files written on Windows
+	while (row.trialSize > 0 && (row.trial[row.trialSize - 1] == '\r' || row.trial[row.trialSize - 1] == ' '))
+	{
+		row.trialSize--;
+	}
+	return true;
+}
+
+/*
+=================
+The function ReadSyncLog streams all records of one trial, or all records if trial is empty, from a logfile or session index into table. Records without a Trial column belong to trial 1, like all records of a recording without session mode. Records of cameras that are not in the table are skipped. It returns the number of records read, or -1 if the file can not be opened. ListSyncCameras returns the serial numbers found in a logfile and ListSyncTrials its trials, both in order of appearance. SyncTrialNumber converts a trial to the number saved in the header.
+=================
+*/
+inline bool SyncRowInTrial(const SyncRow& row, const std::string& trial)
+{
+	if (trial.empty())
+	{
+		return true;
+	}
+	if (row.trialSize == 0)
+	{
+		return trial == "1";
+	}
+	return trial.compare(0, std::string::npos, row.trial, row.trialSize) == 0;
+}
+
+inline int64_t ReadSyncLog(const std::string& logFilename, const std::string& trial, SyncTable& table)
+{
+	std::ifstream logFile(logFilename, std::ios_base::in | std::ios_base::binary);
+	if (!logFile.is_open())
+	{
+		return -1;
+	}
+	std::vector<char> readBuffer(1 << 22);
+	logFile.rdbuf()->pubsetbuf(readBuffer.data(), readBuffer.size());
+
+	std::string line;
+	std::getline(logFile, line);
+	bool machineColumn = line.compare(0, 7, "Machine") == 0;
+
+	int64_t records = 0;
+	int lastCamera = 0;
+	SyncRow row;
+	while (std::getline(logFile, line))
+	{
+		if (!ParseSyncRow(line, machineColumn, row))
+		{
+			continue;
+		}
+		if (!SyncRowInTrial(row, trial))
+		{
+			continue;
+		}
+
+		// Rows of one camera tend to follow each other, try the last match first
+		int camera = -1;
+		for (size_t i = 0; i < table.cameras.size() && camera < 0; i++)
+		{
+			int c = (int)((lastCamera + i) % table.cameras.size());
+			if (table.cameras[c].serial.compare(0, std::string::npos, row.serial, row.serialSize) == 0)
+			{
+				camera = c;
+			}
+		}
+		if (camera < 0)
+		{
+			continue;
+		}
+		lastCamera = camera;
+
+		table.Add({ row.frameID, row.timestamp, row.systemTime, camera });
+		records++;
+	}
+	table.Finish();
+	return records;
+}
+
+inline std::vector<std::string> ListSyncCameras(const std::string& logFilename, const std::string& trial)
+{
+	std::vector<std::string> serials;
+	std::ifstream logFile(logFilename, std::ios_base::in | std::ios_base::binary);
+	std::string line;
+	std::getline(logFile, line);
+	bool machineColumn = line.compare(0, 7, "Machine") == 0;
+
+	SyncRow row;
+	while (std::getline(logFile, line))
+	{
+		if (!ParseSyncRow(line, machineColumn, row) || !SyncRowInTrial(row, trial))
+		{
+			continue;
+		}
+		std::string serial(row.serial, row.serialSize);
+		if (std::find(serials.begin(), serials.end(), serial) == serials.end())
+		{
+			serials.push_back(serial);
+		}
+	}
+	return serials;
+}
+
+inline std::vector<std::string> ListSyncTrials(const std::string& logFilename)
+{
+	std::vector<std::string> trials;
+	std::ifstream logFile(logFilename, std::ios_base::in | std::ios_base::binary);
+	std::string line;
+	std::getline(logFile, line);
+	bool machineColumn = line.compare(0, 7, "Machine") == 0;
+
+	SyncRow row;
+	while (std::getline(logFile, line))
+	{
+		if (!ParseSyncRow(line, machineColumn, row))
+		{
+			continue;
+		}
+		std::string trial = (row.trialSize > 0) ? std::string(row.trial, row.trialSize) : "1";
+		if (std::find(trials.begin(), trials.end(), trial) == trials.end())
+		{
+			trials.push_back(trial);
+		}
+	}
+	return trials;
+}
+
+inline uint32_t SyncTrialNumber(const std::string& trial)
+{
+	if (trial.empty() || trial.find_first_not_of("0123456789") != std::string::npos)
+	{
+		return 0;
+	}
+	return (uint32_t)strtoul(trial.c_str(), nullptr, 10);
+}
+
+/*
+=================
+The function ReportSyncTable prints the alignment statistics of every camera: frames aligned, session frames missing, dropped duplicates, FrameID steps corrected by timestamps, clock drift against the first camera, frame interval jitter and arrival skew on the host.
+=================
+*/
+inline void ReportSyncTable(const SyncTable& table, std::ostream& out)
+{
+	out << "Session frames: " << table.framesEmitted << " at " << table.frameRate << " FPS" << std::endl;
+	double referencePeriod = table.cameras.empty() ? 0 : table.cameras[0].periodNs;
+	for (const SyncCamera& camera : table.cameras)
+	{
+		out << "Camera [" << camera.serial << "]: " << camera.aligned << " frames aligned, " << camera.missing << " missing, "
+			<< camera.dropped << " dropped, " << camera.idMismatches << " FrameID corrections";
+		if (camera.intervals > 0)
+		{
+			out << ", drift " << (camera.periodNs / referencePeriod - 1) * 1e6 << " ppm, jitter " << camera.jitterSumNs / camera.intervals / 1000
+				<< " us mean " << camera.jitterMaxNs / 1000 << " us max";
+		}
+		if (camera.skewCount > 0)
+		{
+			double mean = camera.skewSumNs / camera.skewCount;
+			double deviation = std::sqrt(std::max(0.0, camera.skewSquareSumNs / camera.skewCount - mean * mean));
+			out << ", skew " << mean / 1e6 << " +- " << deviation / 1e6 << " ms, " << camera.skewMaxNs / 1e6 << " ms max";
+		}
+		out << std::endl;
+	}
+	if (table.lateRecords > 0)
+	{
+		out << "Warning: " << table.lateRecords << " records arrived after their session frame was written!" << std::endl;
+	}
+}
+
+/*
+=================
+The functions WriteSyncTableHeader, WriteSyncTableRow and ReadSyncTable save and load .sync files. The writer starts the file with frames = 0 and writes the header again with the final count once all rows are written. ReadSyncTable hands every row to onRow in order, as SyncTable does while aligning. It only reads files of SYNC_VERSION.
+=================
+*/
+inline bool WriteSyncTableHeader(std::ofstream& file, const SyncTable& table, uint64_t frames)
+{
+	SyncTableHeader header = {};
+	header.magic = SYNC_MAGIC;
+	header.version = SYNC_VERSION;
+	header.cameras = (uint32_t)table.cameras.size();
+	header.trial = table.trial;
+	header.frames = frames;
+	header.frameRate = table.frameRate;
+
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const SyncCamera& camera : table.cameras)
+	{
+		char serial[SYNC_SERIAL_SIZE] = {};
+		camera.serial.copy(serial, SYNC_SERIAL_SIZE - 1);
+		file.write(serial, SYNC_SERIAL_SIZE);
+	}
+	return file.good();
+}
+
+inline bool WriteSyncTableRow(std::ofstream& file, size_t cameras, const int32_t* offsets, const uint64_t* frameIDs)
+{
+	file.write(reinterpret_cast<const char*>(offsets), cameras * sizeof(int32_t));
+	file.write(reinterpret_cast<const char*>(frameIDs), cameras * sizeof(uint64_t));
+	return file.good();
+}
+
+inline int ReadSyncTable(const std::string& filename, std::vector<std::string>& serials, double& frameRate, uint32_t& trial, const std::function<void(int64_t sessionFrame, const int32_t* offsets, const uint64_t* frameIDs)>& onRow)
+{
+	std::ifstream file(filename, std::ios_base::in | std::ios_base::binary);
+	SyncTableHeader header = {};
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != SYNC_MAGIC || header.version != SYNC_VERSION)
+	{
+		return -1;
+	}
+	frameRate = header.frameRate;
+	trial = header.trial;
+
+	serials.clear();
+	for (uint32_t c = 0; c < header.cameras; c++)
+	{
+		char serial[SYNC_SERIAL_SIZE] = {};
+		file.read(serial, SYNC_SERIAL_SIZE);
+		serial[SYNC_SERIAL_SIZE - 1] = '\0';
+		serials.push_back(serial);
+	}
+
+	std::vector<int32_t> row(header.cameras);
+	std::vector<uint64_t> frameIDs(header.cameras);
+	for (uint64_t frame = 0; frame < header.frames; frame++)
+	{
+		if (!file.read(reinterpret_cast<char*>(row.data()), row.size() * sizeof(int32_t))
+			|| !file.read(reinterpret_cast<char*>(frameIDs.data()), frameIDs.size() * sizeof(uint64_t)))
+		{
+			return -1;
+		}
+		onRow((int64_t)frame, row.data(), frameIDs.data());
+	}
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+====================================================================================================
+This program tests TCPtoBIN on one machine or over the network. It streams a test file through the
+TcpSink of RECtoBIN to a running TCPtoBIN and compares the received file byte by byte, then sends a
+message with an oversized image, which TCPtoBIN has to reject by closing only that connection, and
+finally streams a second file to check that the receiver still serves new connections.
+Start TCPtoBIN first, e.g. TCPtoBIN 5005 received, then run:
+TCPloopbackTest <host> <port> <receive directory> [frames] [MB per frame]
+The receive directory is the directory TCPtoBIN writes to, as seen from this machine.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#include "FrameSink.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+using namespace std::chrono;
+using namespace std;
+
+/*
+=================
+The function TestFrame fills one frame with a pattern that differs between frames, so that lost, repeated or reordered frames are found by the comparison.
+=================
+*/
+void TestFrame(uint64_t frame, vector<char>& image)
+{
+	for (size_t i = 0; i < image.size(); i++)
+	{
+		image[i] = (char)((frame * 31 + i * 7 + (i >> 12)) & 0xFF);
+	}
+}
+
+/*
+=================
+The function SendTestFile streams frames test frames as filename through a TcpSink, like one camera of RECtoBIN. It returns 0 on success and -1 on errors.
+=================
+*/
+int SendTestFile(const string& host, int port, const string& filename, uint64_t frames, size_t frameSize)
+{
+	TcpSink sink(host, port, 0);
+	if (sink.Open(filename) != 0)
+	{
+		cout << "Unable to connect to TCPtoBIN on " << host << ":" << port << endl;
+		return -1;
+	}
+
+	vector<char> image(frameSize);
+	auto sendStart = steady_clock::now();
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		TestFrame(frame, image);
+		if (sink.Write(image.data(), image.size(), frame, frame * 10000000) != 0)
+		{
+			cout << "Error sending frame " << frame << endl;
+			return -1;
+		}
+	}
+	if (sink.Close() != 0)
+	{
+		return -1;
+	}
+	double seconds = duration<double>(steady_clock::now() - sendStart).count();
+	cout << "Sent " << filename << ": " << frames << " frames in " << seconds << " s, "
+		<< (seconds > 0 ? frames * frameSize / (1024.0 * 1024.0) / seconds : 0.0) << " MB/s" << endl;
+	return 0;
+}
+
+/*
+=================
+The function CheckReceivedFile waits up to 10 s until the received file has its full size and compares it with the test frames. It returns 0 if the file is identical and -1 otherwise.
+=================
+*/
+int CheckReceivedFile(const string& receivedFilename, uint64_t frames, size_t frameSize)
+{
+	const uint64_t expectedSize = frames * frameSize;
+	auto waitStart = steady_clock::now();
+	uint64_t size = 0;
+	while (steady_clock::now() - waitStart < seconds(10))
+	{
+		ifstream file(receivedFilename.c_str(), ios_base::in | ios_base::binary | ios_base::ate);
+		size = file.is_open() ? (uint64_t)file.tellg() : 0;
+		if (size >= expectedSize)
+		{
+			break;
+		}
+		this_thread::sleep_for(milliseconds(10));
+	}
+	if (size != expectedSize)
+	{
+		cout << receivedFilename << " has " << size << " bytes, expected " << expectedSize << endl;
+		return -1;
+	}
+
+	ifstream file(receivedFilename.c_str(), ios_base::in | ios_base::binary);
+	vector<char> expected(frameSize);
+	vector<char> received(frameSize);
+	for (uint64_t frame = 0; frame < frames; frame++)
+	{
+		TestFrame(frame, expected);
+		if (!file.read(received.data(), received.size()) || received != expected)
+		{
+			cout << receivedFilename << " differs in frame " << frame << endl;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+=================
+The function SendOversizedFrame announces an image larger than SINK_MAX_FRAME on a new connection. TCPtoBIN has to close the connection without waiting for the image, it returns 0 if the connection was closed within 5 s.
+=================
+*/
+int SendOversizedFrame(const string& host, int port)
+{
+	struct addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &addresses) != 0)
+	{
+		return -1;
+	}
+	SinkSocket socketHandle = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+	bool connected = socketHandle != INVALID_SOCKET && connect(socketHandle, addresses->ai_addr, (int)addresses->ai_addrlen) == 0;
+	freeaddrinfo(addresses);
+	if (!connected)
+	{
+		cout << "Unable to connect to TCPtoBIN on " << host << ":" << port << endl;
+		return -1;
+	}
+
+#if defined(_WIN32)
+	DWORD timeout = 5000;
+#else
+	struct timeval timeout = { 5, 0 };
+#endif
+	setsockopt(socketHandle, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+	SinkMessage message = {};
+	message.magic = SINK_MAGIC;
+	message.type = SINK_FRAME;
+	message.size = SINK_MAX_FRAME + 1;
+	SinkPart parts[1] = { { reinterpret_cast<const char*>(&message), sizeof(message) } };
+	SendParts(socketHandle, parts, 1);
+
+	// The receiver sends nothing, recv returns 0 once it has closed the connection
+	char byte;
+	int received = recv(socketHandle, &byte, 1, 0);
+	CloseSocket(socketHandle);
+	return received == 0 ? 0 : -1;
+}
+
+/*
+=================
+This is the Entry point for the program. It runs the three tests and returns 0 if all of them passed.
+=================
+*/
+int main(int argc, char** argv)
+{
+	cout << "*************************************************************" << endl;
+	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
+	cout << "MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com" << endl;
+	cout << "*************************************************************" << endl;
+
+	if (argc < 4)
+	{
+		cout << "Usage: TCPloopbackTest <host> <port> <receive directory> [frames] [MB per frame]" << endl;
+		return -1;
+	}
+	string host = argv[1];
+	int port = stoi(argv[2]);
+	string directory = argv[3];
+	if (!directory.empty() && directory.back() != '/' && directory.back() != '\\')
+	{
+		directory += "/";
+	}
+	uint64_t frames = (argc > 4) ? stoull(argv[4]) : 50;
+	size_t frameSize = (size_t)(((argc > 5) ? stod(argv[5]) : 5.0) * 1024 * 1024);
+
+	if (!StartSockets())
+	{
+		cout << "Unable to start sockets. Aborting..." << endl;
+		return -1;
+	}
+
+	int failed = 0;
+
+	cout << endl << "*** TEST 1: STREAM A FILE ***" << endl << endl;
+	string filename = "loopback_test_file1.tmp";
+	int result = SendTestFile(host, port, filename, frames, frameSize);
+	if (result == 0)
+	{
+		result = CheckReceivedFile(directory + filename, frames, frameSize);
+	}
+	cout << (result == 0 ? "PASSED" : "FAILED") << endl;
+	failed += (result != 0);
+
+	cout << endl << "*** TEST 2: REJECT AN OVERSIZED FRAME ***" << endl << endl;
+	result = SendOversizedFrame(host, port);
+	cout << (result == 0 ? "PASSED" : "FAILED, the connection was not closed") << endl;
+	failed += (result != 0);
+
+	cout << endl << "*** TEST 3: STREAM A FILE AFTER THE REJECTED CONNECTION ***" << endl << endl;
+	filename = "loopback_test_file2.tmp";
+	result = SendTestFile(host, port, filename, 10, 1024 * 1024);
+	if (result == 0)
+	{
+		result = CheckReceivedFile(directory + filename, 10, 1024 * 1024);
+	}
+	cout << (result == 0 ? "PASSED" : "FAILED") << endl;
+	failed += (result != 0);
+
+	cout << endl << (failed == 0 ? "All tests passed" : to_string(failed) + " tests failed") << endl;
+	return failed == 0 ? 0 : -1;
+}
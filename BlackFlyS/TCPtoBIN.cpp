@@ -0,0 +1,203 @@
+/*
+====================================================================================================
+This program runs on a storage node and receives the binary .tmp files that RECtoBIN streams over
+TCP when sinkHost is set in the config file. Every camera of the recorder uses its own connection,
+each connection is served in its own thread and writes its files to the given directory with the
+same names as a local recording, so they can be converted with BINtoAVI as usual. The csv logfile
+and the metadata stay on the recording machine and are copied next to the files for conversion.
+Start it before RECtoBIN with: TCPtoBIN <port> <directory>. Stop it with Ctrl+C after recording.
+It can be tested on one machine with sinkHost=127.0.0.1.
+
+MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com
+Sourcecode: https://github.com/Guillermo-Hidalgo-Gadea/syncFLIR
+====================================================================================================
+*/
+
+#include "FrameSink.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+using namespace std::chrono;
+using namespace std;
+
+int port = 5005;
+string directory;
+
+// console output of the connection threads
+mutex coutMutex;
+
+/*
+=================
+The function ReceiveFiles serves one connection until the recorder closes it. SINK_OPEN starts a new file in directory, SINK_FRAME appends one image and SINK_CLOSE finishes the file and reports its size and receive rate. Filenames are reduced to their last component, so a sender can not write outside directory. Sizes above SINK_MAX_NAME and SINK_MAX_FRAME close the connection before anything is allocated, the other connections are not affected.
+=================
+*/
+void ReceiveFiles(SinkSocket connection)
+{
+	ofstream file;
+	string filename;
+	vector<char> image;
+	uint64_t frames = 0;
+	uint64_t bytes = 0;
+	auto fileStart = steady_clock::now();
+
+	SinkMessage message;
+	while (ReceiveAll(connection, reinterpret_cast<char*>(&message), sizeof(message)))
+	{
+		if (message.magic != SINK_MAGIC)
+		{
+			lock_guard<mutex> lock(coutMutex);
+			cout << "Invalid message received, closing connection..." << endl;
+			break;
+		}
+
+		if ((message.type == SINK_OPEN && message.size > SINK_MAX_NAME) || (message.type == SINK_FRAME && message.size > SINK_MAX_FRAME))
+		{
+			lock_guard<mutex> lock(coutMutex);
+			cout << "Message of " << message.size << " bytes exceeds the limit, closing connection..." << endl;
+			break;
+		}
+
+		if (message.type == SINK_OPEN)
+		{
+			string name((size_t)message.size, '\0');
+			if (!ReceiveAll(connection, &name[0], name.size()))
+			{
+				break;
+			}
+			name = name.substr(name.find_last_of("/\\") + 1);
+			if (name.empty() || name == "." || name == "..")
+			{
+				break;
+			}
+
+			if (file.is_open())
+			{
+				file.close();
+			}
+			filename = directory + name;
+			file.open(filename.c_str(), ios_base::out | ios_base::binary);
+			frames = 0;
+			bytes = 0;
+			fileStart = steady_clock::now();
+
+			lock_guard<mutex> lock(coutMutex);
+			if (!file.good())
+			{
+				cout << "Unable to create file " << filename << ". Aborting..." << endl;
+				break;
+			}
+			cout << "Camera " << message.camera << " receiving " << filename << endl;
+		}
+		else if (message.type == SINK_FRAME)
+		{
+			image.resize((size_t)message.size);
+			if (!ReceiveAll(connection, image.data(), image.size()))
+			{
+				break;
+			}
+			if (!file.is_open())
+			{
+				continue;
+			}
+			file.write(image.data(), image.size());
+			frames++;
+			bytes += message.size;
+			if (!file.good())
+			{
+				lock_guard<mutex> lock(coutMutex);
+				cout << "Error writing to file " << filename << " !" << endl;
+				break;
+			}
+		}
+		else if (message.type == SINK_CLOSE)
+		{
+			if (file.is_open())
+			{
+				file.close();
+				double seconds = duration<double>(steady_clock::now() - fileStart).count();
+				lock_guard<mutex> lock(coutMutex);
+				cout << "Camera " << message.camera << " saved " << filename << ": " << frames << " frames, " << bytes / (1024 * 1024) << " MB, "
+					<< (seconds > 0 ? bytes / (1024 * 1024) / seconds : 0.0) << " MB/s" << endl;
+			}
+		}
+	}
+
+	if (file.is_open())
+	{
+		file.close();
+		lock_guard<mutex> lock(coutMutex);
+		cout << "Connection closed, " << filename << " saved with " << frames << " frames" << endl;
+	}
+	CloseSocket(connection);
+}
+
+/*
+=================
+This is the Entry point for the program. It listens on port and starts one ReceiveFiles thread per connection.
+=================
+*/
+int main(int argc, char** argv)
+{
+	cout << "*************************************************************" << endl;
+	cout << "Application build date: " << __DATE__ << " " << __TIME__ << endl;
+	cout << "MIT License Copyright (c) 2021 GuillermoHidalgoGadea.com" << endl;
+	cout << "*************************************************************" << endl;
+
+	if (argc > 1)
+	{
+		port = stoi(argv[1]);
+	}
+	if (argc > 2)
+	{
+		directory = argv[2];
+		if (!directory.empty() && directory.back() != '/' && directory.back() != '\\')
+		{
+			directory += "/";
+		}
+	}
+
+	if (!StartSockets())
+	{
+		cout << "Unable to start sockets. Aborting..." << endl;
+		return -1;
+	}
+
+	SinkSocket listener = socket(AF_INET, SOCK_STREAM, 0);
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons((unsigned short)port);
+	if (listener == INVALID_SOCKET || bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0)
+	{
+		cout << "Unable to listen on port " << port << ". Aborting..." << endl;
+		return -1;
+	}
+
+	cout << "Waiting for recordings on port " << port << ", saving to " << (directory.empty() ? "current directory" : directory) << endl;
+
+	while (true)
+	{
+		SinkSocket connection = accept(listener, nullptr, nullptr);
+		if (connection == INVALID_SOCKET)
+		{
+			break;
+		}
+
+		// Large receive buffer to ride out short disk stalls
+		int receiveBuffer = 64 * 1024 * 1024;
+		setsockopt(connection, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&receiveBuffer), sizeof(receiveBuffer));
+
+		thread(ReceiveFiles, connection).detach();
+	}
+
+	CloseSocket(listener);
+	return 0;
+}